@@ -11,6 +11,7 @@
 {.name="<",                   .calltype=call, .argc=2, .args={number, number},      .returns=true, .rettype=boolean},
 {.name="<=",                  .calltype=call, .argc=2, .args={number, number},      .returns=true, .rettype=boolean},
 {.name="==",                  .calltype=call, .argc=2, .args={any, any},            .returns=true, .rettype=boolean, .overload=true, .overloads={number, symbol, table, string, boolean, block, list, box, io, NIL}},
+{.name="hash",                .calltype=call, .argc=1, .args={any},                 .returns=true, .rettype=number},
 {.name="^",                   .calltype=call, .argc=2, .args={number, number},      .returns=true, .rettype=number},
 {.name="match",               .calltype=call, .argc=2, .args={any, any},            .returns=true, .rettype=boolean},
 {.name="if",                  .calltype=branch, .argc=3, .args={boolean, any, any},   .returns=true, .rettype=any},
@@ -34,6 +35,11 @@
 {.name="string?",             .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean, .overload=true, .overloads={number, symbol, table, string, boolean, block, list, box, io, NIL}},
 {.name="block?",              .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean, .overload=true, .overloads={number, symbol, table, string, boolean, block, list, box, io, NIL}},
 {.name="boolean?",            .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean, .overload=true, .overloads={number, symbol, table, string, boolean, block, list, box, io, NIL}},
+{.name="array?",              .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean},
+{.name="vector?",             .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean},
+{.name="sequence?",           .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean},
+{.name="builder?",            .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean},
+{.name="bytes?",              .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean},
 {.name="table?",              .calltype=call, .argc=1, .args={any},       .returns=true, .rettype=boolean, .overload=true, .overloads={number, symbol, table, string, boolean, block, list, box, io, NIL}},
 {.name="number!",             .calltype=call, .argc=1, .args={number}, .returns=true, .rettype=number},
 {.name="symbol!",             .calltype=call, .argc=1, .args={symbol}, .returns=true, .rettype=symbol},
@@ -44,18 +50,29 @@
 {.name="block!",              .calltype=call, .argc=1, .args={block},  .returns=true, .rettype=block},
 {.name="boolean!",            .calltype=call, .argc=1, .args={boolean},.returns=true, .rettype=boolean},
 {.name="table!",              .calltype=call, .argc=1, .args={table},  .returns=true, .rettype=table},
+{.name="array!",              .calltype=call, .argc=1, .args={array},  .returns=true, .rettype=array},
+{.name="vector!",             .calltype=call, .argc=1, .args={vector}, .returns=true, .rettype=vector},
+{.name="sequence!",           .calltype=call, .argc=1, .args={sequence}, .returns=true, .rettype=sequence},
+{.name="builder!",            .calltype=call, .argc=1, .args={builder}, .returns=true, .rettype=builder},
+{.name="bytes!",              .calltype=call, .argc=1, .args={bytes},  .returns=true, .rettype=bytes},
 
-{.name="first",               .calltype=call, .argc=1, .args={any},      .returns=true, .rettype=any, .overload=true, .overloads={list,string,NIL}, .overload_returns={any, string, NIL}},
-{.name="rest",                .calltype=call, .argc=1, .args={any},      .returns=true, .rettype=any, .overload=true, .overloads={list,string,NIL}, .overload_returns={list, string, NIL}},
+{.name="first",               .calltype=call, .argc=1, .args={any},      .returns=true, .rettype=any, .overload=true, .overloads={list,string,sequence,NIL}, .overload_returns={any, any, any, NIL}},
+{.name="rest",                .calltype=call, .argc=1, .args={any},      .returns=true, .rettype=any, .overload=true, .overloads={list,string,sequence,NIL}, .overload_returns={list, string, sequence, NIL}},
 {.name="push",                .calltype=call, .argc=2, .args={any, list}, .returns=true, .rettype=list},
-{.name="empty?",              .calltype=call, .argc=1, .args={any},      .returns=true, .rettype=boolean, .overload=true, .overloads={list, string, table, NIL}},
-{.name="append",              .calltype=call, .argc=2, .args={any, any}, .returns=true, .rettype=any, .overload=true, .overloads={string, list, NIL}, .overload_returns={string, list, NIL}},
-{.name="substring",           .calltype=call, .argc=3, .args={number, number, string}, .returns=true, .rettype=string},
+{.name="empty?",              .calltype=call, .argc=1, .args={any},      .returns=true, .rettype=boolean, .overload=true, .overloads={list, string, table, sequence, NIL}},
+{.name="append",              .calltype=call, .argc=2, .args={any, any}, .returns=true, .rettype=any, .overload=true, .overloads={string, list, sequence, bytes, NIL}, .overload_returns={string, list, sequence, bytes, NIL}},
+{.name="substring",           .calltype=call, .argc=3, .args={number, number, any},    .returns=true, .rettype=any},
 {.name="regex",               .calltype=call, .argc=2, .args={string, string},    .returns=true, .rettype=boolean},
 {.name="regex-match",         .calltype=call, .argc=2, .args={string, string},    .returns=true, .rettype=boolean, .stack=true},
+{.name="regex-find-all",      .calltype=call, .argc=2, .args={string, string},    .returns=true, .rettype=list},
+{.name="regex-split",         .calltype=call, .argc=2, .args={string, string},    .returns=true, .rettype=list},
+{.name="regex-replace",       .calltype=call, .argc=3, .args={string, string, string}, .returns=true, .rettype=string},
 {.name="ordinal",             .calltype=call, .argc=1, .args={string}, .returns=true, .rettype=number},
-{.name="character",           .calltype=call, .argc=1, .args={number}, .returns=true, .rettype=string},
-{.name="split",               .calltype=call, .argc=2, .args={string, string}, .returns=true, .rettype=list},
+{.name="character",           .calltype=call, .argc=1, .args={number}, .returns=true, .rettype=any},
+{.name="split",               .calltype=call, .argc=2, .args={string, any},    .returns=true, .rettype=list},
+{.name="find",                .calltype=call, .argc=2, .args={string, any},    .returns=true, .rettype=number},
+{.name="contains?",           .calltype=call, .argc=2, .args={string, any},    .returns=true, .rettype=boolean},
+{.name="replace",             .calltype=call, .argc=3, .args={string, string, any}, .returns=true, .rettype=string},
 {.name="uppercase",           .calltype=call, .argc=1, .args={string}, .returns=true, .rettype=string},
 {.name="lowercase",           .calltype=call, .argc=1, .args={string}, .returns=true, .rettype=string},
 {.name="floor",               .calltype=call, .argc=1, .args={number}, .returns=true, .rettype=number},
@@ -68,6 +85,7 @@
 //{.name="precompute",          .calltype=call, .argc=1, .args={block},   .returns=true, .rettype=block},
 {.name="wait",                .calltype=call, .argc=1, .args={number},  .returns=false},
 {.name="stop",                .calltype=call, .argc=0, .returns=false},
+{.name="flush",               .calltype=call, .argc=0, .returns=false},
 {.name="show",                .calltype=call, .argc=1, .args={any},     .returns=true, .rettype=string, .overload=true, .overloads={number, symbol, table, string, boolean, block, list, box, io, NIL} },
 {.name="stack",               .calltype=call, .returns=true, .rettype=list, .stack=true},
 {.name="clear",               .calltype=call, .argc=0, .stack=true},
@@ -115,8 +133,50 @@
 {.name="has",                   .calltype=call, .argc=2, .args={any, table}, .returns=true, .rettype=boolean},
 {.name="values",                .calltype=call, .argc=1, .args={table},      .returns=true, .rettype=list},
 {.name="keys",                  .calltype=call, .argc=1, .args={table},      .returns=true, .rettype=list},
+{.name="union",                 .calltype=call, .argc=2, .args={table, table}, .returns=true, .rettype=table},
+{.name="intersection",          .calltype=call, .argc=2, .args={table, table}, .returns=true, .rettype=table},
+{.name="difference",            .calltype=call, .argc=2, .args={table, table}, .returns=true, .rettype=table},
+{.name="merge",                 .calltype=call, .argc=3, .args={block, table, table}, .returns=true, .rettype=table},
 
-{.name="length",                .calltype=call, .argc=1, .args={any}, .overload=true, .overloads={list, table, string, NIL}, .returns=true, .rettype=number},
+{.name="length",                .calltype=call, .argc=1, .args={any}, .overload=true, .overloads={list, table, string, array, vector, sequence, builder, bytes, NIL}, .returns=true, .rettype=number},
+{.name="index",                 .calltype=call, .argc=2, .args={number, any},  .returns=true, .rettype=any},
+
+{.name="array",                 .calltype=call, .argc=1, .args={block},        .returns=true, .rettype=array},
+{.name="array-from",            .calltype=call, .argc=1, .args={list},         .returns=true, .rettype=array},
+{.name="numbers",               .calltype=call, .argc=2, .args={string, any},  .returns=true, .rettype=array},
+{.name="parse-json",            .calltype=call, .argc=1, .args={any},          .returns=true, .rettype=any},
+{.name="json",                  .calltype=call, .argc=1, .args={any},          .returns=true, .rettype=string},
+{.name="elements",              .calltype=call, .argc=1, .args={any},          .returns=true, .rettype=list, .overload=true, .overloads={array, sequence, bytes, NIL}},
+{.name="element",               .calltype=call, .argc=2, .args={number, array}, .returns=true, .rettype=number},
+{.name="sum",                   .calltype=call, .argc=1, .args={array},        .returns=true, .rettype=number},
+{.name="product",               .calltype=call, .argc=1, .args={array},        .returns=true, .rettype=number},
+{.name="minimum",               .calltype=call, .argc=1, .args={array},        .returns=true, .rettype=number},
+{.name="maximum",               .calltype=call, .argc=1, .args={array},        .returns=true, .rettype=number},
+{.name="dot",                   .calltype=call, .argc=2, .args={array, array}, .returns=true, .rettype=number},
+{.name="add-arrays",            .calltype=call, .argc=2, .args={array, array}, .returns=true, .rettype=array},
+{.name="multiply-arrays",       .calltype=call, .argc=2, .args={array, array}, .returns=true, .rettype=array},
+{.name="scale",                 .calltype=call, .argc=2, .args={number, array}, .returns=true, .rettype=array},
+
+{.name="vector",                .calltype=call, .argc=1, .args={block},        .returns=true, .rettype=vector},
+{.name="make-vector",           .calltype=call, .argc=2, .args={number, any},  .returns=true, .rettype=vector},
+{.name="set-at",                .calltype=call, .argc=3, .args={number, vector, any}, .returns=false},
+{.name="push-back",             .calltype=call, .argc=2, .args={any, vector},  .returns=false},
+
+{.name="sequence",              .calltype=call, .argc=1, .args={block},        .returns=true, .rettype=sequence},
+{.name="sequence-from",         .calltype=call, .argc=1, .args={list},         .returns=true, .rettype=sequence},
+{.name="update",                .calltype=call, .argc=3, .args={number, sequence, any}, .returns=true, .rettype=sequence},
+{.name="push-end",              .calltype=call, .argc=2, .args={any, sequence}, .returns=true, .rettype=sequence},
+{.name="slice",                 .calltype=call, .argc=3, .args={number, number, any}, .returns=true, .rettype=any},
+
+{.name="builder",               .calltype=call, .argc=0,                       .returns=true, .rettype=builder},
+{.name="add",                   .calltype=call, .argc=2, .args={any, builder}, .returns=false},
+{.name="contents",              .calltype=call, .argc=1, .args={builder},      .returns=true, .rettype=string},
+{.name="join",                  .calltype=call, .argc=2, .args={string, list}, .returns=true, .rettype=string},
+
+{.name="bytes-from",            .calltype=call, .argc=1, .args={any},          .returns=true, .rettype=bytes},
+{.name="string-from-bytes",     .calltype=call, .argc=1, .args={bytes},        .returns=true, .rettype=string},
+{.name="unpack",                .calltype=call, .argc=3, .args={symbol, number, bytes}, .returns=true, .rettype=number},
+{.name="pack",                  .calltype=call, .argc=2, .args={symbol, number}, .returns=true, .rettype=bytes},
 
 /* Builtin stack operations */
 //{.name="drop",                .calltype=stack_op, .stack_shuffle=&drop_register},
@@ -132,7 +192,29 @@
 {.name="open",                .calltype=call, .argc=2, .args={symbol, string}, .returns=true, .rettype=io},
 {.name="read-file",           .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=string},
 {.name="read-line",           .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=string},
+{.name="lines",               .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=list},
+{.name="for-each-line",       .calltype=call, .argc=2, .args={io, block}, .returns=false},
+{.name="standard-input",      .calltype=call, .returns=true, .rettype=io},
+{.name="csv-rows",            .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=list},
+{.name="csv-records",         .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=list},
+{.name="for-each-csv-row",    .calltype=call, .argc=2, .args={io, block}, .returns=false},
+{.name="for-each-csv-record", .calltype=call, .argc=2, .args={io, block}, .returns=false},
+{.name="tsv-rows",            .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=list},
+{.name="tsv-records",         .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=list},
+{.name="for-each-tsv-row",    .calltype=call, .argc=2, .args={io, block}, .returns=false},
+{.name="for-each-tsv-record", .calltype=call, .argc=2, .args={io, block}, .returns=false},
+{.name="read-json",           .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=any},
+{.name="for-each-json-event", .calltype=call, .argc=2, .args={io, block}, .returns=false},
+{.name="write-json",          .calltype=call, .argc=2, .args={any, io}, .returns=false},
 {.name="close",               .calltype=call, .argc=1, .args={io}},
+{.name="write",               .calltype=call, .argc=2, .args={string, io}, .returns=false},
+{.name="write-all",           .calltype=call, .argc=2, .args={list, io}, .returns=false},
+{.name="read-bytes",          .calltype=call, .argc=2, .args={number, io}, .returns=true, .rettype=bytes},
+{.name="read-file-bytes",     .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=bytes},
+{.name="write-bytes",         .calltype=call, .argc=2, .args={bytes, io}, .returns=false},
+{.name="read-table",          .calltype=call, .argc=1, .args={io}, .returns=true, .rettype=table},
+{.name="write-table",         .calltype=call, .argc=2, .args={table, io}, .returns=false},
+{.name="write-value",         .calltype=call, .argc=2, .args={any, io}, .returns=false},
 {.name="path",                .calltype=call, .returns=true, .rettype=string},
 {.name="seek",                .calltype=call, .argc=3, .args={symbol, number, io}, .returns=false},
 #endif
@@ -14,6 +14,7 @@
 #include <sys/mman.h>
 #include <sys/wait.h>
 #include <execinfo.h>
+#include <regex.h>
 
 
 #define STR_(x) #x
@@ -27,7 +28,12 @@ module_t prelude1 = { .prefix = "prelude" }; // written in C
 module_t prelude2 = { .prefix = "prelude" }; // written in Cognate
 module_list_t preludes = { .mod=&prelude2, .next = &(module_list_t){.mod=&prelude1, .next=NULL} };
 
-const char* builtin_symbols[] = { "start", "end", "current", "read", "write", "append", "read-write", "read-append", "read-write-existing" };
+const char* builtin_symbols[] = { "start", "end", "current", "read", "write", "append", "read-write", "read-append", "read-write-existing", "null", "object", "array", "key", "value",
+	"u8", "i8", "u16-le", "u16-be", "i16-le", "i16-be", "u32-le", "u32-be", "i32-le", "i32-be",
+	"u64-le", "u64-be", "i64-le", "i64-be", "f32-le", "f32-be", "f64-le", "f64-be" };
+
+// Builtins whose first argument is a regex. Literal patterns get a static slot, so they're only compiled once.
+const char* regex_builtins[] = { "regex", "regex-match", "regex-find-all", "regex-split", "regex-replace" };
 
 char runtime_filename[] = "/tmp/cognac-runtime-XXXXXX.h";
 
@@ -754,6 +760,11 @@ const char* print_val_type(val_type_t type)
 		case any:    return "any";
 		case box:    return "box";
 		case io:     return "io";
+		case array:  return "array";
+		case vector: return "vector";
+		case sequence: return "sequence";
+		case builder: return "builder";
+		case bytes:  return "bytes";
 		case NIL:    return "NIL";
 		case strong_any: return "strong_any";
 	}
@@ -776,6 +787,11 @@ const char* c_val_type(val_type_t type)
 		case any:    return "ANY";
 		case box:    return "BOX";
 		case io:     return "IO";
+		case array:  return "ARRAY";
+		case vector: return "VECTOR";
+		case sequence: return "SEQUENCE";
+		case builder: return "BUILDER";
+		case bytes:  return "BYTES";
 		case strong_any: return "STRONG_ANY";
 		case NIL:    unreachable();
 	}
@@ -871,9 +887,63 @@ void to_exe(module_t* mod)
 	if (status != EXIT_SUCCESS) exit(status);
 }
 
-void c_emit_funcall(func_t* fn, FILE* c_source, reg_dequeue_t* registers)
+ast_t* literal_regex(func_t* fn, reg_dequeue_t* registers)
+{
+	// The literal pattern of a regex builtin, or NULL if the pattern is only known at runtime.
+	if (!fn->builtin || !registers->front || !registers->front->source) return NULL;
+	ast_t* op = registers->front->source->op;
+	if (op->type != literal || op->literal->type != string) return NULL;
+	for (size_t i = 0 ; i < sizeof(regex_builtins) / sizeof(regex_builtins[0]) ; ++i)
+		if (!strcmp(regex_builtins[i], fn->unmangled_name)) return op;
+	return NULL;
+}
+
+void check_regex(ast_t* op)
+{
+	// Unescapes the literal and compiles it, so errors in the pattern are reported by cognac.
+	const char* lit = op->literal->string;
+	char pattern[strlen(lit)];
+	size_t n = 0;
+	for (const char* c = lit + 1 ; c[1] ; ++c)
+	{
+		if (*c != '\\') { pattern[n++] = *c; continue; }
+		switch (*++c)
+		{
+			case 'a': pattern[n++] = '\a'; break;
+			case 'b': pattern[n++] = '\b'; break;
+			case 'f': pattern[n++] = '\f'; break;
+			case 'n': pattern[n++] = '\n'; break;
+			case 'r': pattern[n++] = '\r'; break;
+			case 't': pattern[n++] = '\t'; break;
+			case 'v': pattern[n++] = '\v'; break;
+			default:  pattern[n++] = *c;
+		}
+	}
+	pattern[n] = '\0';
+	// The runtime's syntax is libc's extended syntax without back-references, which it can't match in linear time.
+	for (const char* c = pattern ; *c ; ++c)
+	{
+		if (*c != '\\' || !c[1]) continue;
+		if (*++c >= '1' && *c <= '9') throw_error("invalid regex (Back-references are not supported)", op->where);
+	}
+	regex_t reg;
+	int status = regcomp(&reg, pattern, REG_EXTENDED | REG_NEWLINE);
+	if (status)
+	{
+		char msg[256];
+		char err[128];
+		regerror(status, &reg, err, sizeof err);
+		snprintf(msg, sizeof msg, "invalid regex (%s)", err);
+		throw_error(msg, op->where);
+	}
+	regfree(&reg);
+}
+
+void c_emit_funcall(func_t* fn, FILE* c_source, reg_dequeue_t* registers, reg_t* regex_slot)
 {
-	if (!fn->overload || fn->overloaded_to == any)
+	if (regex_slot)
+		fprintf(c_source, "%s_literal(&_regex_%zu, ", sanitize(fn->name), regex_slot->id);
+	else if (!fn->overload || fn->overloaded_to == any)
 		fprintf(c_source, "%s(", sanitize(fn->name));
 	else
 		fprintf(c_source, "%s_%s(", sanitize(fn->name), c_val_type(fn->overloaded_to));
@@ -1045,12 +1115,12 @@ void to_c(module_t* mod)
 								{
 									reg_t* r1 = pop_register_front(registers);
 									fprintf(c_source, "_%zu ? ", r1->id);
-									c_emit_funcall(f->func, c_source, registers);
+									c_emit_funcall(f->func, c_source, registers, NULL);
 									fprintf(c_source, " : ");
 								}
 								else
 								{
-									c_emit_funcall(f->func, c_source, registers);
+									c_emit_funcall(f->func, c_source, registers, NULL);
 									fprintf(c_source, ";\n");
 								}
 								*registers = saved;
@@ -1070,12 +1140,12 @@ void to_c(module_t* mod)
 								{
 									reg_t* r1 = pop_register_front(registers);
 									fprintf(c_source, "\tif (_%zu) ", r1->id);
-									c_emit_funcall(f->func, c_source, registers);
+									c_emit_funcall(f->func, c_source, registers, NULL);
 									fprintf(c_source, ";\n\telse ");
 								}
 								else
 								{
-									c_emit_funcall(f->func, c_source, registers);
+									c_emit_funcall(f->func, c_source, registers, NULL);
 									fprintf(c_source, ";\n");
 								}
 								*registers = saved;
@@ -1131,7 +1201,7 @@ void to_c(module_t* mod)
 
 				case literal:
 					{
-						reg_t* reg = make_register(op->op->literal->type, NULL);
+						reg_t* reg = make_register(op->op->literal->type, op); // The source lets calls spot literal arguments.
 						push_register_front(reg, registers);
 						fprintf(c_source, "\t%s _%zu = %s;\n",
 							c_val_type(op->op->literal->type),
@@ -1212,6 +1282,14 @@ void to_c(module_t* mod)
 						reg_t* r = NULL;
 						func_t* fn = op->op->func;
 						bool nopush = false;
+						reg_t* regex_slot = NULL;
+						ast_t* pattern = literal_regex(fn, registers);
+						if (pattern)
+						{
+							check_regex(pattern);
+							regex_slot = registers->front;
+							fprintf(c_source, "\tstatic compiled_regex* _regex_%zu = NULL;\n", regex_slot->id);
+						}
 						if (fn->returns)
 						{
 							if (op->next->op->type == ret && (!op->next->next || (op->next->next->op->type == none && !op->next->next->next)))
@@ -1229,7 +1307,7 @@ void to_c(module_t* mod)
 							}
 						}
 						else fprintf(c_source, "\t");
-						c_emit_funcall(fn, c_source, registers);
+						c_emit_funcall(fn, c_source, registers, regex_slot);
 						fprintf(c_source, ";\n");
 						if (fn->returns && !nopush) push_register_front(r, registers);
 						break;
@@ -68,6 +68,11 @@ typedef enum _val_type_t
 	list,
 	box,
 	io,
+	array,
+	vector,
+	sequence,
+	builder,
+	bytes,
 	any,
 	strong_any,
 } val_type_t;
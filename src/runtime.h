@@ -15,10 +15,12 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <locale.h>
+#include <langinfo.h>
 #include <signal.h>
 #include <sys/resource.h>
 #include <time.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,18 +30,21 @@
 #include <setjmp.h>
 #include <stdbool.h>
 
-#ifdef __TINYC__
-#define __nmatch
-#endif
-
-#include <regex.h>
-
 #define KILOBYTE 1024l
 #define MEGABYTE 1024l*KILOBYTE
 #define GIGABYTE 1024l*MEGABYTE
 #define TERABYTE 1024l*GIGABYTE
 #define ALLOC_SIZE 100l*GIGABYTE
 #define ALLOC_START (void*)(42l * TERABYTE)
+#define STDOUT_BUFFER_SIZE 64l*KILOBYTE
+#define TABLE_FILE_MAGIC "COGTAB1"
+#define TABLE_FILE_BASE 64l*TERABYTE
+#define TABLE_FILE_SLOT 4l*GIGABYTE
+#define TABLE_FILE_SLOTS 4096
+#define WRITE_BUFFER_SIZE 64l*KILOBYTE
+#define WRITE_PIECE_SIZE 4l*KILOBYTE // Strings at least this big are written from where they are, without copying.
+#define JSON_CHUNK_SIZE 16l*KILOBYTE
+#define JSON_MAX_DEPTH 10000
 
 #ifdef GCTEST
 #define GC_FIRST_THRESHOLD 16
@@ -74,6 +79,11 @@ typedef const struct cognate_list* LIST;
 typedef const char* SYMBOL;
 typedef struct cognate_file* IO;
 typedef struct cognate_table* TABLE;
+typedef const struct cognate_array* ARRAY;
+typedef struct cognate_vector* VECTOR;
+typedef const struct cognate_sequence* SEQUENCE;
+typedef struct cognate_builder* BUILDER;
+typedef const struct cognate_bytes* BYTES;
 
 typedef struct cognate_block
 {
@@ -90,6 +100,14 @@ typedef struct cognate_block
 #define TABLE_TYPE   ( NIL | 0x0000000000000004 )
 #define IO_TYPE      ( NIL | 0x0000000000000005 )
 #define BLOCK_TYPE   ( NIL | 0x0000000000000006 )
+#define ARRAY_TYPE   ( NIL | 0x0000000000000007 )
+#define VECTOR_TYPE  ( NIL | 0x8000000000000002 ) // All 8 low tags are taken, so the sign bit extends them.
+#define SEQUENCE_TYPE ( NIL | 0x8000000000000003 )
+#define BUILDER_TYPE ( NIL | 0x8000000000000004 )
+#define BYTES_TYPE   ( NIL | 0x8000000000000005 )
+#define VIEW_TYPE    ( STRING_TYPE | 0x8000000000000000 ) // Views are strings to everything but the runtime.
+#define SHORT_STRING_TYPE ( VIEW_TYPE | 0x0000800000000000 ) // Above every user space pointer, so the GC never mistakes one for an address.
+#define SHORT_STRING_MAX 5 // Bytes held in the low bits of a short string, in memory order.
 
 typedef struct cognate_object
 {
@@ -104,6 +122,11 @@ typedef struct cognate_object
 		NUMBER number;
 		IO io;
 		TABLE table;
+		ARRAY array;
+		VECTOR vector;
+		SEQUENCE sequence;
+		BUILDER builder;
+		BYTES bytes;
 		void* ptr;
 	};
 	cognate_type type;
@@ -124,11 +147,70 @@ typedef struct cognate_list
 	ANY object;
 } cognate_list;
 
+typedef struct cognate_array
+{
+	size_t length;
+	NUMBER items[]; // Unboxed, so the GC never looks inside.
+} cognate_array;
+
+typedef struct cognate_vector
+{
+	size_t length;
+	size_t capacity;
+	ANY* items; // Separate so it can be reallocated when the vector grows.
+} cognate_vector;
+
+typedef struct cognate_builder
+{
+	size_t bytes;
+	size_t capacity;
+	char* data; // In the main heap, since it holds no pointers and so can be written whatever its generation.
+} cognate_builder;
+
+typedef struct cognate_bytes
+{
+	size_t length;
+	uint8_t* data; // Just after the header, or inside another bytes object for a slice, or in a mapped file.
+} cognate_bytes;
+
+#define SEQUENCE_SHIFT 5
+#define SEQUENCE_WIDTH (1 << SEQUENCE_SHIFT)
+
+typedef struct cognate_sequence
+{
+	size_t height; // Leaves have height 0.
+	size_t count;  // Items in a leaf, or children of a branch.
+	size_t length; // Items in the whole tree.
+	union
+	{
+		ANY items[0];
+		SEQUENCE children[0]; // Followed by the cumulative length of each child.
+	};
+} cognate_sequence;
+
+#define seq_sizes(s) ((const size_t*)&(s)->children[(s)->count])
+
+typedef struct string_header
+{
+	size_t bytes; // Not counting the NUL terminator.
+	size_t chars; // Counted on first use, since that depends on the locale.
+} string_header;
+
+#define STRING_CHARS_UNKNOWN SIZE_MAX
+
+typedef struct string_view
+{
+	const char* start; // Points into another string, which keeps it alive.
+	size_t bytes;      // Not NUL terminated, since the other string carries on.
+	size_t chars;
+} string_view;
+
 typedef struct cognate_file
 {
 	STRING path;
 	STRING mode;
 	FILE* file;
+	char* buffer; // The stream's buffer when it's written to, which is bigger than stdio's.
 } cognate_file;
 
 typedef struct cognate_stack
@@ -176,6 +258,9 @@ static bool mz = 0;
 
 static _Bool pure = 0;
 
+static bool utf8_locale = false; // Lets strings be scanned without asking the locale about every character.
+
+
 // Global variables
 static cognate_stack stack;
 static LIST cmdline_parameters = NULL;
@@ -191,6 +276,20 @@ static const char* function_stack_start;
 
 static TABLE memoized_regexes = NULL;
 
+#define HASH_CACHE_SIZE 4096 // Must be a power of two.
+
+typedef struct hash_cache_entry
+{
+	ANY object;
+	uint64_t hash;
+	size_t epoch;
+} hash_cache_entry;
+
+// Structural hashes of lists, tables, arrays, sequences and strings, keyed by address.
+// The GC moves objects, so it bumps the epoch to invalidate the whole cache.
+static hash_cache_entry hash_cache[HASH_CACHE_SIZE];
+static size_t hash_epoch = 1;
+
 const SYMBOL SYMstart = "start";
 const SYMBOL SYMend = "end";
 const SYMBOL SYMcurrent = "current";
@@ -200,11 +299,36 @@ const SYMBOL SYMappend = "append";
 const SYMBOL SYMreadHwrite = "read-write";
 const SYMBOL SYMreadHappend = "read-append";
 const SYMBOL SYMreadHwriteHexisting = "read-write-existing";
+const SYMBOL SYMnull = "null";
+const SYMBOL SYMobject = "object";
+const SYMBOL SYMarray = "array";
+const SYMBOL SYMkey = "key";
+const SYMBOL SYMvalue = "value";
+const SYMBOL SYMu8 = "u8";
+const SYMBOL SYMi8 = "i8";
+const SYMBOL SYMu16Hle = "u16-le";
+const SYMBOL SYMu16Hbe = "u16-be";
+const SYMBOL SYMi16Hle = "i16-le";
+const SYMBOL SYMi16Hbe = "i16-be";
+const SYMBOL SYMu32Hle = "u32-le";
+const SYMBOL SYMu32Hbe = "u32-be";
+const SYMBOL SYMi32Hle = "i32-le";
+const SYMBOL SYMi32Hbe = "i32-be";
+const SYMBOL SYMu64Hle = "u64-le";
+const SYMBOL SYMu64Hbe = "u64-be";
+const SYMBOL SYMi64Hle = "i64-le";
+const SYMBOL SYMi64Hbe = "i64-be";
+const SYMBOL SYMf32Hle = "f32-le";
+const SYMBOL SYMf32Hbe = "f32-be";
+const SYMBOL SYMf64Hle = "f64-le";
+const SYMBOL SYMf64Hbe = "f64-be";
 
 // Variables and	needed by functions.c defined in runtime.c
 static void init_stack(void);
 static void init_general_purpose_buffer(void);
 static STRING show_object(const ANY object, char*, LIST);
+static void print_object(ANY, FILE*, LIST);
+static void put_object(ANY, FILE*);
 static void _Noreturn __attribute__((format(printf, 1, 2))) throw_error_fmt(const char* const, ...);
 static void _Noreturn throw_error(const char* const);
 static ptrdiff_t compare_objects(ANY, ANY);
@@ -225,8 +349,26 @@ static void gc_collect_mutable(void);
 static void gc_init(void);
 static char* gc_strdup(char*);
 static char* gc_strndup(char*, size_t);
+static char* gc_malloc_string(size_t);
+static cognate_bytes* bytes_alloc(size_t);
+static BYTES bytes_view(const uint8_t*, size_t);
+static string_header* string_header_of(STRING);
+static size_t string_bytes(STRING);
+static size_t string_chars(STRING);
+static size_t count_chars(const char*, size_t);
+static size_t char_bytes(const char*, size_t);
+static string_view* view_of(ANY);
+static bool flat_string(ANY);
+static ANY short_string(const char*, size_t);
+static STRING short_flatten(ANY);
+static size_t view_chars(string_view*);
+static STRING view_flatten(string_view*);
+static ANY make_view(const char*, size_t, size_t);
+static STRING string_span(const ANY*, size_t*);
 static void gc_mark_ptr(void*);
 static void gc_mark_any(ANY*);
+static void gc_mark_mutable_ptr(void*);
+static void gc_mark_mutable_any(ANY*);
 static bool any_is_ptr(ANY);
 static void gc_bitmap_or(gc_heap*, size_t, uint8_t);
 static void gc_bitmap_set(gc_heap*, size_t, uint8_t);
@@ -251,6 +393,16 @@ static IO unbox_IO(ANY);
 static ANY box_IO(IO);
 static TABLE unbox_TABLE(ANY);
 static ANY box_TABLE(TABLE);
+static ARRAY unbox_ARRAY(ANY);
+static ANY box_ARRAY(ARRAY);
+static VECTOR unbox_VECTOR(ANY);
+static ANY box_VECTOR(VECTOR);
+static SEQUENCE unbox_SEQUENCE(ANY);
+static ANY box_SEQUENCE(SEQUENCE);
+static BUILDER unbox_BUILDER(ANY);
+static ANY box_BUILDER(BUILDER);
+static BYTES unbox_BYTES(ANY);
+static ANY box_BYTES(BYTES);
 
 static NUMBER early_NUMBER(BOX);
 static BOX early_BOX(BOX);
@@ -261,6 +413,11 @@ static SYMBOL early_SYMBOL(BOX);
 static BLOCK early_BLOCK(BOX);
 static IO early_IO(BOX);
 static TABLE early_TABLE(BOX);
+static ARRAY early_ARRAY(BOX);
+static VECTOR early_VECTOR(BOX);
+static SEQUENCE early_SEQUENCE(BOX);
+static BUILDER early_BUILDER(BOX);
+static BYTES early_BYTES(BOX);
 static ANY early_ANY(BOX);
 
 static NUMBER radians_to_degrees(NUMBER);
@@ -273,6 +430,9 @@ static ANY peek(void);
 static int stack_length(void);
 
 static TABLE mktable(ANY, ANY, TABLE, TABLE, size_t);
+static void table_flatten(TABLE);
+static void seq_flatten(SEQUENCE);
+static uint64_t hash_object(ANY);
 
 // Builtin functions needed by compiled source file defined in functions.c
 static TABLE ___insert(ANY, ANY, TABLE);
@@ -311,19 +471,28 @@ static BOOLEAN ___integerQ(ANY);
 static BOOLEAN ___ioQ(ANY);
 static BOOLEAN ___zeroQ(ANY);
 static BOOLEAN ___tableQ(ANY);
+static BOOLEAN ___arrayQ(ANY);
+static BOOLEAN ___vectorQ(ANY);
+static BOOLEAN ___sequenceQ(ANY);
+static BOOLEAN ___builderQ(ANY);
+static BOOLEAN ___bytesQ(ANY);
 static ANY ___first(ANY);
 static ANY ___rest(ANY);
-static STRING ___first_STRING(STRING);
+static ANY ___first_STRING(STRING);
 static STRING ___rest_STRING(STRING);
 static ANY ___first_LIST(LIST);
 static LIST ___rest_LIST(LIST);
+static ANY ___first_SEQUENCE(SEQUENCE);
+static SEQUENCE ___rest_SEQUENCE(SEQUENCE);
+static BOOLEAN ___emptyQ_SEQUENCE(SEQUENCE);
+static LIST ___elements_BYTES(BYTES);
 static STRING ___head(STRING);
 static STRING ___tail(STRING);
 static LIST ___push(ANY, LIST);
 static BOOLEAN ___emptyQ(ANY);
 static LIST ___list(BLOCK);
-static STRING ___join(STRING, STRING);
-static STRING ___substring(NUMBER, NUMBER, STRING);
+static STRING ___join(STRING, LIST);
+static ANY ___substring(NUMBER, NUMBER, ANY);
 static STRING ___input(void);
 static IO ___open(SYMBOL, STRING);
 static void ___close(IO);
@@ -332,6 +501,7 @@ static STRING ___path(void);
 static LIST ___stack(void);
 static LIST ___parameters(void);
 static void ___stop(void);
+static void ___flush(void);
 static STRING ___show(ANY);
 static STRING ___show_NUMBER(NUMBER);
 static STRING ___show_LIST(LIST);
@@ -345,8 +515,11 @@ static STRING ___show_BOX(BOX);
 
 static BOOLEAN ___regex(STRING, STRING);
 static BOOLEAN ___regexHmatch(STRING, STRING);
+static LIST ___regexHfindHall(STRING, STRING);
+static LIST ___regexHsplit(STRING, STRING);
+static STRING ___regexHreplace(STRING, STRING, STRING);
 static NUMBER ___ordinal(STRING);
-static STRING ___character(NUMBER);
+static ANY ___character(NUMBER);
 static NUMBER ___floor(NUMBER);
 static NUMBER ___round(NUMBER);
 static NUMBER ___ceiling(NUMBER);
@@ -354,7 +527,10 @@ static NUMBER ___abs(NUMBER);
 static void ___error(STRING);
 //static BLOCK ___precompute(BLOCK);
 static void ___wait(NUMBER);
-static LIST ___split(STRING, STRING);
+static LIST ___split(STRING, ANY);
+static NUMBER ___find(STRING, ANY);
+static BOOLEAN ___containsQ(STRING, ANY);
+static STRING ___replace(STRING, STRING, ANY);
 //static BLOCK ___remember(BLOCK);
 
 static NUMBER ___sind(NUMBER);
@@ -385,6 +561,9 @@ static NUMBER ___tanh(NUMBER);
 static const char *lookup_type(cognate_type);
 static ptrdiff_t compare_lists(LIST, LIST);
 static ptrdiff_t compare_tables(TABLE, TABLE);
+static ptrdiff_t compare_arrays(ARRAY, ARRAY);
+static ptrdiff_t compare_vectors(VECTOR, VECTOR);
+static ptrdiff_t compare_sequences(SEQUENCE, SEQUENCE);
 static _Bool match_lists(LIST, LIST);
 static void handle_error_signal(int, siginfo_t*, void *);
 static void assert_impure(void);
@@ -410,6 +589,9 @@ int main(int argc, char** argv)
 	{
 		throw_error("Cannot set locale");
 	}
+	utf8_locale = !strcmp(nl_langinfo(CODESET), "UTF-8");
+	// Line buffer output to a terminal, but write pipes and files in large blocks.
+	setvbuf(stdout, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, STDOUT_BUFFER_SIZE);
 	// Init GC
 	gc_init();
 	// Seed the random number generator properly.
@@ -442,6 +624,7 @@ int main(int argc, char** argv)
 
 static void cleanup(void)
 {
+	fflush(stdout);
 	if unlikely(stack.top != stack.start)
 		throw_error_fmt("Exiting with %ti object(s) on the stack", stack.top - stack.start);
 }
@@ -661,6 +844,7 @@ static void print_backtrace(int n, const backtrace* b, int last_spaces)
 static _Noreturn __attribute__((format(printf, 1, 2))) void throw_error_fmt(const char* const fmt, ...)
 {
 	char buf[1024];
+	fflush(stdout); // So the output comes before the error.
 	fputs("\n\n\033[31;1m    ", stderr);
 	va_list args;
 	va_start(args, fmt);
@@ -783,10 +967,10 @@ static char* show_io(IO i, char* buffer)
 		return buffer + sprintf(buffer, "{ %s CLOSED }", i->path);
 }
 
-static char* show_string(STRING s, char* buffer)
+static char* show_string(STRING s, size_t bytes, char* buffer)
 {
 	*buffer++ = '"';
-	for (const char* str = s ; *str ; ++str)
+	for (const char* str = s ; str != s + bytes ; ++str)
 	{
 		char c = *str;
 		if unlikely(c >= '\a' && c <= '\r')
@@ -803,9 +987,65 @@ static char* show_string(STRING s, char* buffer)
 	return buffer;
 }
 
+static char* show_digits(uint64_t u, char* buffer)
+{
+	char digits[20];
+	char* d = digits + sizeof digits;
+	do *--d = '0' + u % 10; while (u /= 10);
+	size_t len = digits + sizeof digits - d;
+	memcpy(buffer, d, len);
+	buffer[len] = '\0';
+	return buffer + len;
+}
+
+static const double powers_of_ten[] = // All exactly representable.
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
 static char* show_number(NUMBER n, char* buffer)
 {
-	return buffer + sprintf(buffer, "%.14g", n);
+	// Gives exactly what %.14g would, but only falls back to sprintf for exponents and for digits that might round either way.
+	const double* powers = powers_of_ten;
+	const double a = fabs(n);
+	if (!(a < 1e14 && (a >= 1e-5 || a == 0))) return buffer + sprintf(buffer, "%.14g", n);
+	if (signbit(n)) *buffer++ = '-';
+	if (a == (double)(uint64_t)a) return show_digits(a, buffer);
+	// Scale to a 14 digit integer. The product is off by less than 0.01, so it rounds the same way unless it's near a half.
+	int e = 0;
+	if (a >= 1) while (a >= powers[e + 1]) ++e;
+	else for (e = -1 ; a * powers[-e] < 1 ; --e);
+	const double scaled = a * powers[13 - e];
+	if (fabs(scaled - floor(scaled) - 0.5) < 0.03) return buffer + sprintf(buffer, "%.14g", a);
+	uint64_t m = scaled + 0.5;
+	if (m == 100000000000000) { m /= 10; ++e; }
+	if (m < 10000000000000 || m >= 100000000000000 || e < -4 || e >= 14) return buffer + sprintf(buffer, "%.14g", a);
+	char digits[16];
+	show_digits(m, digits);
+	int last = 13;
+	while (digits[last] == '0') --last;
+	if (e >= 0)
+	{
+		memcpy(buffer, digits, e + 1);
+		buffer += e + 1;
+		if (last > e)
+		{
+			*buffer++ = '.';
+			memcpy(buffer, digits + e + 1, last - e);
+			buffer += last - e;
+		}
+	}
+	else
+	{
+		*buffer++ = '0';
+		*buffer++ = '.';
+		for (int i = -1 ; i > e ; --i) *buffer++ = '0';
+		memcpy(buffer, digits, last + 1);
+		buffer += last + 1;
+	}
+	*buffer = '\0';
+	return buffer;
 }
 
 static char* show_list(LIST l, char* buffer, LIST checked)
@@ -823,6 +1063,82 @@ static char* show_list(LIST l, char* buffer, LIST checked)
 	return buffer;
 }
 
+static char* show_array(ARRAY a, char* buffer)
+{
+	*buffer++ = '#';
+	*buffer++ = '(';
+	for (size_t i = 0 ; i < a->length ; ++i)
+	{
+		if (i) *buffer++ = ' ';
+		buffer = show_number(a->items[i], buffer);
+	}
+	*buffer++ = ')';
+	*buffer = '\0';
+	return buffer;
+}
+
+static char* show_vector(VECTOR v, char* buffer, LIST checked)
+{
+	for (LIST l = checked ; l ; l = l->next)
+		if (l->object == box_VECTOR(v))
+		{
+			buffer += sprintf(buffer, "...");
+			return buffer;
+		}
+	checked = ___push(box_VECTOR(v), checked);
+	*buffer++ = '{';
+	for (size_t i = 0 ; i < v->length ; ++i)
+	{
+		if (i) *buffer++ = ' ';
+		buffer = (char*)show_object(v->items[i], buffer, checked);
+	}
+	*buffer++ = '}';
+	*buffer = '\0';
+	return buffer;
+}
+
+static char* show_builder(BUILDER b, char* buffer)
+{
+	return buffer + sprintf(buffer, "<builder of %zu bytes>", b->bytes);
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static char* show_bytes(BYTES b, char* buffer)
+{
+	*buffer++ = '#';
+	*buffer++ = '[';
+	for (size_t i = 0 ; i < b->length ; ++i)
+	{
+		if (i) *buffer++ = ' ';
+		*buffer++ = hex_digits[b->data[i] >> 4];
+		*buffer++ = hex_digits[b->data[i] & 0xf];
+	}
+	*buffer++ = ']';
+	*buffer = '\0';
+	return buffer;
+}
+
+static char* show_sequence_items(SEQUENCE s, char* buffer, LIST checked)
+{
+	for (size_t i = 0 ; i < s->count ; ++i)
+	{
+		if (s->height) buffer = show_sequence_items(s->children[i], buffer, checked);
+		else buffer = (char*)show_object(s->items[i], buffer, checked);
+		*buffer++ = ' ';
+	}
+	return buffer;
+}
+
+static char* show_sequence(SEQUENCE s, char* buffer, LIST checked)
+{
+	*buffer++ = '<';
+	if (s) buffer = show_sequence_items(s, buffer, checked) - 1;
+	*buffer++ = '>';
+	*buffer = '\0';
+	return buffer;
+}
+
 static char* show_boolean(BOOLEAN b, char* buffer)
 {
 	return buffer + sprintf(buffer, "%s", b ? "True" : "False");
@@ -868,21 +1184,208 @@ static STRING show_object (const ANY object, char* buffer, LIST checked)
 		case NUMBER_TYPE:  buffer = show_number (*(NUMBER*)&object,             buffer);           break;
 		case IO_TYPE:      buffer = show_io     ((IO)      (object & PTR_MASK), buffer);           break;
 		case BOOLEAN_TYPE: buffer = show_boolean((BOOLEAN) (object & PTR_MASK), buffer);           break;
-		case STRING_TYPE:  buffer = show_string ((STRING)  (object & UNALIGNED_PTR_MASK), buffer); break;
+		case STRING_TYPE:
+			{
+				size_t bytes;
+				STRING s = string_span(&object, &bytes);
+				buffer = show_string(s, bytes, buffer);
+				break;
+			}
 		case SYMBOL_TYPE:  buffer = show_symbol ((SYMBOL)  (object & UNALIGNED_PTR_MASK), buffer); break;
 		case BLOCK_TYPE:   buffer = show_block  ((BLOCK)   (object & PTR_MASK), buffer);           break;
 		case TABLE_TYPE:   buffer = show_table  ((TABLE)   (object & PTR_MASK), buffer, checked);  break;
 		case LIST_TYPE:    buffer = show_list   ((LIST)    (object & PTR_MASK), buffer, checked);  break;
 		case BOX_TYPE:     buffer = show_box    ((BOX)     (object & PTR_MASK), buffer, checked);  break;
+		case ARRAY_TYPE:   buffer = show_array  ((ARRAY)   (object & PTR_MASK), buffer);           break;
+		case VECTOR_TYPE:  buffer = show_vector ((VECTOR)  (object & PTR_MASK), buffer, checked);  break;
+		case SEQUENCE_TYPE:buffer = show_sequence((SEQUENCE)(object & PTR_MASK), buffer, checked); break;
+		case BUILDER_TYPE: buffer = show_builder((BUILDER) (object & PTR_MASK), buffer);           break;
+		case BYTES_TYPE:   buffer = show_bytes  ((BYTES)   (object & PTR_MASK), buffer);           break;
 	}
 	return buffer;
 }
 
+// The print_ functions write the same thing as the show_ functions, but straight to a FILE.
+// Only as much memory as the nesting depth of the object is needed to print it.
+
+static void print_string(STRING s, size_t bytes, FILE* f)
+{
+	fputc('"', f);
+	for (const char* str = s ; str != s + bytes ; ++str)
+	{
+		char c = *str;
+		if unlikely(c >= '\a' && c <= '\r')
+		{
+			fputc('\\', f);
+			fputc("abtnvfr"[c-'\a'], f);
+		}
+		else if (c == '\\') fputs("\\\\", f);
+		else if (c == '"')  fputs("\\\"", f);
+		else fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void print_list(LIST l, FILE* f, LIST checked)
+{
+	fputc('(', f);
+	for ( ; l ; l = l->next)
+	{
+		print_object(l->object, f, checked);
+		if (l->next) fputc(' ', f);
+	}
+	fputc(')', f);
+}
+
+static void print_table_helper(TABLE d, FILE* f, LIST checked)
+{
+	if (!d) return;
+	print_table_helper(d->left, f, checked);
+	print_object(d->key, f, checked);
+	fputc(':', f);
+	print_object(d->value, f, checked);
+	fputc(' ', f);
+	print_table_helper(d->right, f, checked);
+}
+
+static void print_array(ARRAY a, FILE* f)
+{
+	char buf[32];
+	fputs("#(", f);
+	for (size_t i = 0 ; i < a->length ; ++i)
+	{
+		if (i) fputc(' ', f);
+		show_number(a->items[i], buf);
+		fputs(buf, f);
+	}
+	fputc(')', f);
+}
+
+static void print_bytes(BYTES b, FILE* f)
+{
+	fputs("#[", f);
+	for (size_t i = 0 ; i < b->length ; ++i)
+	{
+		if (i) fputc(' ', f);
+		fputc(hex_digits[b->data[i] >> 4], f);
+		fputc(hex_digits[b->data[i] & 0xf], f);
+	}
+	fputc(']', f);
+}
+
+static void print_vector(VECTOR v, FILE* f, LIST checked)
+{
+	for (LIST l = checked ; l ; l = l->next)
+		if (l->object == box_VECTOR(v))
+		{
+			fputs("...", f);
+			return;
+		}
+	checked = ___push(box_VECTOR(v), checked);
+	fputc('{', f);
+	for (size_t i = 0 ; i < v->length ; ++i)
+	{
+		if (i) fputc(' ', f);
+		print_object(v->items[i], f, checked);
+	}
+	fputc('}', f);
+}
+
+static bool print_sequence_items(SEQUENCE s, FILE* f, LIST checked, bool first)
+{
+	for (size_t i = 0 ; i < s->count ; ++i)
+	{
+		if (s->height) first = print_sequence_items(s->children[i], f, checked, first);
+		else
+		{
+			if (!first) fputc(' ', f);
+			print_object(s->items[i], f, checked);
+			first = false;
+		}
+	}
+	return first;
+}
+
+static void print_box(BOX b, FILE* f, LIST checked)
+{
+	for (LIST l = checked ; l ; l = l->next)
+		if ((BOX)(l->object & PTR_MASK) == b)
+		{
+			fputs("...", f);
+			return;
+		}
+	checked = ___push(box_BOX(b), checked);
+	fputc('[', f);
+	print_object(*b, f, checked);
+	fputc(']', f);
+}
+
+static void print_object(ANY object, FILE* f, LIST checked)
+{
+	switch (type_of(object))
+	{
+		case STRING_TYPE:
+			{
+				size_t bytes;
+				STRING s = string_span(&object, &bytes);
+				print_string(s, bytes, f);
+				break;
+			}
+		case SYMBOL_TYPE:  fputs((SYMBOL)(object & UNALIGNED_PTR_MASK), f); break;
+		case IO_TYPE:
+			{
+				IO i = (IO)(object & PTR_MASK);
+				if (i->file != NULL) fprintf(f, "{ %s OPEN mode '%s' }", i->path, i->mode);
+				else fprintf(f, "{ %s CLOSED }", i->path);
+				break;
+			}
+		case TABLE_TYPE:
+			fputs("{ ", f);
+			print_table_helper((TABLE)(object & PTR_MASK), f, checked);
+			fputc('}', f);
+			break;
+		case LIST_TYPE:    print_list  ((LIST)  (object & PTR_MASK), f, checked); break;
+		case BOX_TYPE:     print_box   ((BOX)   (object & PTR_MASK), f, checked); break;
+		case ARRAY_TYPE:   print_array ((ARRAY) (object & PTR_MASK), f);          break;
+		case VECTOR_TYPE:  print_vector((VECTOR)(object & PTR_MASK), f, checked); break;
+		case BYTES_TYPE:   print_bytes ((BYTES) (object & PTR_MASK), f);          break;
+		case SEQUENCE_TYPE:
+			fputc('<', f);
+			if (object & PTR_MASK) print_sequence_items((SEQUENCE)(object & PTR_MASK), f, checked, true);
+			fputc('>', f);
+			break;
+		default:
+			{
+				// Everything else is short enough for a small buffer.
+				char buf[64];
+				show_object(object, buf, NULL);
+				fputs(buf, f);
+			}
+	}
+}
+
+static void put_object(ANY a, FILE* f)
+{
+	// Strings are written without quotes, like Put.
+	if (___stringQ(a))
+	{
+		size_t bytes;
+		STRING s = string_span(&a, &bytes);
+		fwrite(s, 1, bytes, f);
+	}
+	else print_object(a, f, NULL);
+}
+
 static void init_general_purpose_buffer(void)
 {
 	general_purpose_buffer = mmap(ALLOC_START, ALLOC_SIZE, MEM_PROT, MEM_FLAGS, -1, 0);
 }
 
+static bool in_general_purpose_buffer(const void* p)
+{
+	return (char*)p >= (char*)general_purpose_buffer && (char*)p < (char*)general_purpose_buffer + ALLOC_SIZE;
+}
+
 static void init_stack(void)
 {
 	stack.absolute_start = stack.top = stack.start
@@ -926,10 +1429,119 @@ static const char* lookup_type(cognate_type type)
 		case BLOCK_TYPE:   return "block";
 		case SYMBOL_TYPE:  return "symbol";
 		case BOOLEAN_TYPE: return "boolean";
+		case ARRAY_TYPE:   return "array";
+		case VECTOR_TYPE:  return "vector";
+		case SEQUENCE_TYPE:return "sequence";
+		case BUILDER_TYPE: return "builder";
+		case BYTES_TYPE:   return "bytes";
 		default:           return NULL;
 	}
 }
 
+static uint64_t hash_mix(uint64_t h)
+{
+	// 64 bit finalizer from MurmurHash3.
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t hash_string(STRING s, size_t bytes)
+{
+	// FNV-1a.
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (STRING end = s + bytes ; s != end ; ++s) h = (h ^ (uint8_t)*s) * 0x100000001b3ull;
+	return h;
+}
+
+static uint64_t hash_list(LIST l)
+{
+	uint64_t h = LIST_TYPE;
+	for ( ; l ; l = l->next) h = hash_mix(h + hash_object(l->object));
+	return h;
+}
+
+static uint64_t hash_array(ARRAY a)
+{
+	uint64_t h = ARRAY_TYPE;
+	for (size_t i = 0 ; i < a->length ; ++i) h = hash_mix(h + hash_mix(*(uint64_t*)&a->items[i] >> 20));
+	return h;
+}
+
+static uint64_t hash_sequence(SEQUENCE s, uint64_t h)
+{
+	for (size_t i = 0 ; s && i < s->count ; ++i)
+		h = s->height ? hash_sequence(s->children[i], h) : hash_mix(h + hash_object(s->items[i]));
+	return h;
+}
+
+static uint64_t hash_table_entries(TABLE t)
+{
+	// Summing the entries makes this independent of the shape of the tree.
+	uint64_t h = 0;
+	for ( ; t ; t = t->right)
+		h += hash_table_entries(t->left) + hash_mix(hash_object(t->key) * 31 + hash_object(t->value));
+	return h;
+}
+
+static uint64_t hash_object(ANY a)
+{
+	// Numbers are compared with a tolerance of a few ulps, so their lowest bits are ignored.
+	// Numbers either side of a 2^20 ulp boundary can still hash differently, so hashes are
+	// never used to decide equality, which is ordered lexicographically anyway.
+	cognate_type t = type_of(a);
+	switch (t)
+	{
+		case NUMBER_TYPE: return hash_mix(a >> 20);
+		case IO_TYPE:     return hash_mix(IO_TYPE ^ (uintptr_t)((IO)(a & PTR_MASK))->file);
+		case LIST_TYPE: case TABLE_TYPE: case STRING_TYPE: case ARRAY_TYPE: case SEQUENCE_TYPE: case BYTES_TYPE: break;
+		default:          return hash_mix(a); // Compared by identity.
+	}
+	hash_cache_entry* e = &hash_cache[hash_mix(a) & (HASH_CACHE_SIZE - 1)];
+	if (e->object == a && e->epoch == hash_epoch) return e->hash;
+	uint64_t h;
+	switch (t)
+	{
+		case LIST_TYPE:  h = hash_list((LIST)(a & PTR_MASK)); break;
+		case TABLE_TYPE: h = hash_mix(TABLE_TYPE + hash_table_entries((TABLE)(a & PTR_MASK))); break;
+		case ARRAY_TYPE: h = hash_array((ARRAY)(a & PTR_MASK)); break;
+		case SEQUENCE_TYPE: h = hash_sequence((SEQUENCE)(a & PTR_MASK), SEQUENCE_TYPE); break;
+		case BYTES_TYPE: h = hash_mix(BYTES_TYPE + hash_string((STRING)((BYTES)(a & PTR_MASK))->data, ((BYTES)(a & PTR_MASK))->length)); break;
+		default:
+			{
+				size_t bytes;
+				STRING s = string_span(&a, &bytes);
+				h = hash_string(s, bytes);
+				// The general purpose buffer is reused, so strings in it can't be cached.
+				if (in_general_purpose_buffer(s)) return h;
+			}
+	}
+	*e = (hash_cache_entry) { .object = a, .hash = h, .epoch = hash_epoch };
+	return h;
+}
+
+typedef struct table_iterator
+{
+	TABLE path[128]; // AA trees are at most 2 log n deep.
+	size_t depth;
+} table_iterator;
+
+static void table_iterator_descend(table_iterator* it, TABLE t)
+{
+	for ( ; t ; t = t->left) it->path[it->depth++] = t;
+}
+
+static TABLE table_iterator_next(table_iterator* it)
+{
+	if (!it->depth) return NULL;
+	TABLE t = it->path[--it->depth];
+	table_iterator_descend(it, t->right);
+	return t;
+}
+
 static ptrdiff_t compare_lists(LIST lst1, LIST lst2)
 {
 	if (lst1 == lst2) return 0;
@@ -948,16 +1560,45 @@ static ptrdiff_t compare_lists(LIST lst1, LIST lst2)
 
 static ptrdiff_t compare_tables(TABLE t1, TABLE t2)
 {
-	if (!t1) return -!!t2;
+	if (t1 == t2) return 0;
+	if (!t1) return -1;
 	if (!t2) return 1;
 
-	ptrdiff_t diff;
-
-	if ((diff = compare_objects(t1->key, t2->key))) return diff;
-	if ((diff = compare_objects(t1->value, t2->value))) return diff;
-	if ((diff = compare_tables(t1->left, t2->left))) return diff;
+	// Equal tables can have different shapes, so compare the entries in order instead, stopping at the first difference.
+	table_iterator it1 = { .depth = 0 }, it2 = { .depth = 0 };
+	table_iterator_descend(&it1, t1);
+	table_iterator_descend(&it2, t2);
+	for (;;)
+	{
+		TABLE e1 = table_iterator_next(&it1);
+		TABLE e2 = table_iterator_next(&it2);
+		if (!e1 || !e2) return !!e1 - !!e2;
+		ptrdiff_t diff;
+		if ((diff = compare_objects(e1->key, e2->key))) return diff;
+		if ((diff = compare_objects(e1->value, e2->value))) return diff;
+	}
+}
 
-	return compare_tables(t1->right, t2->right);
+static ptrdiff_t compare_sequences(SEQUENCE s1, SEQUENCE s2)
+{
+	if (s1 == s2) return 0;
+	if (!s1) return -1;
+	if (!s2) return 1;
+	ptrdiff_t diff;
+	// Equal sequences can have different shapes, so compare the items in order.
+	ANYPTR base = stack.top;
+	seq_flatten(s1);
+	ANYPTR mid = stack.top;
+	seq_flatten(s2);
+	ANYPTR end = stack.top;
+	for (ANYPTR a = base, b = mid ; ; ++a, ++b)
+	{
+		if (a == mid) { diff = -(b != end); break; }
+		if (b == end) { diff = 1; break; }
+		if ((diff = compare_objects(*a, *b))) break;
+	}
+	stack.top = base;
+	return diff;
 }
 
 static ptrdiff_t compare_blocks(BLOCK b1, BLOCK b2)
@@ -977,9 +1618,36 @@ static ptrdiff_t compare_numbers(NUMBER n1, NUMBER n2)
 	return diff / (FLOAT_MAX_ULPS + 1);
 }
 
+static ptrdiff_t compare_arrays(ARRAY a1, ARRAY a2)
+{
+	if (a1 == a2) return 0;
+	ptrdiff_t diff;
+	size_t len = a1->length < a2->length ? a1->length : a2->length;
+	for (size_t i = 0 ; i < len ; ++i)
+		if ((diff = compare_numbers(a1->items[i], a2->items[i]))) return diff;
+	return (a1->length > a2->length) - (a1->length < a2->length);
+}
+
 static ptrdiff_t compare_strings(STRING s1, STRING s2)
 {
-	return strcmp(s1, s2);
+	if (s1 == s2) return 0;
+	string_header* h1 = string_header_of(s1);
+	string_header* h2 = string_header_of(s2);
+	if (!h1 || !h2) return strcmp(s1, s2);
+	// Comparing the terminator too orders a prefix before the longer string, just like strcmp.
+	return memcmp(s1, s2, (h1->bytes < h2->bytes ? h1->bytes : h2->bytes) + 1);
+}
+
+static ptrdiff_t compare_string_objects(ANY a1, ANY a2)
+{
+	if (flat_string(a1) && flat_string(a2))
+		return compare_strings((STRING)(a1 & UNALIGNED_PTR_MASK), (STRING)(a2 & UNALIGNED_PTR_MASK));
+	size_t n1, n2;
+	STRING s1 = string_span(&a1, &n1);
+	STRING s2 = string_span(&a2, &n2);
+	int diff = memcmp(s1, s2, n1 < n2 ? n1 : n2);
+	if (diff) return diff;
+	return (n1 > n2) - (n1 < n2);
 }
 
 static ptrdiff_t compare_io(IO i1, IO i2)
@@ -999,7 +1667,28 @@ static ptrdiff_t compare_boxes(BOX b1, BOX b2)
 
 static ptrdiff_t compare_symbols(SYMBOL s1, SYMBOL s2)
 {
-	return s1 - s2;
+	// Symbols are interned, but are ordered by name so that table keys don't depend on memory layout.
+	return s1 == s2 ? 0 : strcmp(s1, s2);
+}
+
+static ptrdiff_t compare_vectors(VECTOR v1, VECTOR v2)
+{
+	// Vectors are mutable, so like boxes they're compared by identity.
+	return v1 - v2;
+}
+
+static ptrdiff_t compare_builders(BUILDER b1, BUILDER b2)
+{
+	return b1 - b2;
+}
+
+static ptrdiff_t compare_bytes(BYTES b1, BYTES b2)
+{
+	if (b1 == b2) return 0;
+	ptrdiff_t diff;
+	size_t len = b1->length < b2->length ? b1->length : b2->length;
+	if (len && (diff = memcmp(b1->data, b2->data, len))) return diff;
+	return (b1->length > b2->length) - (b1->length < b2->length);
 }
 
 static ptrdiff_t compare_objects(ANY ob1, ANY ob2)
@@ -1012,7 +1701,7 @@ static ptrdiff_t compare_objects(ANY ob1, ANY ob2)
 	switch (t1)
 	{
 		case NUMBER_TYPE:  return compare_numbers(*(NUMBER*)&ob1, *(NUMBER*)&ob2);
-		case STRING_TYPE:  return compare_strings((STRING)(ob1 & UNALIGNED_PTR_MASK), (STRING)(ob2 & UNALIGNED_PTR_MASK));
+		case STRING_TYPE:  return compare_string_objects(ob1, ob2);
 		case LIST_TYPE:    return compare_lists((LIST)(ob1 & PTR_MASK), (LIST)(ob2 & PTR_MASK));
 		case BLOCK_TYPE:   return compare_blocks((BLOCK)(ob1 & PTR_MASK), (BLOCK)(ob2 & PTR_MASK));
 		case TABLE_TYPE:   return compare_tables((TABLE)(ob1 & PTR_MASK), (TABLE)(ob2 & PTR_MASK));
@@ -1020,6 +1709,11 @@ static ptrdiff_t compare_objects(ANY ob1, ANY ob2)
 		case BOOLEAN_TYPE: return compare_booleans((BOOLEAN)(ob1 & PTR_MASK), (BOOLEAN)(ob2 & PTR_MASK));
 		case BOX_TYPE:     return compare_boxes((BOX)(ob1 & PTR_MASK), (BOX)(ob2 & PTR_MASK));
 		case SYMBOL_TYPE:  return compare_symbols((SYMBOL)(ob1 & UNALIGNED_PTR_MASK), (SYMBOL)(ob2 & UNALIGNED_PTR_MASK));
+		case ARRAY_TYPE:   return compare_arrays((ARRAY)(ob1 & PTR_MASK), (ARRAY)(ob2 & PTR_MASK));
+		case VECTOR_TYPE:  return compare_vectors((VECTOR)(ob1 & PTR_MASK), (VECTOR)(ob2 & PTR_MASK));
+		case SEQUENCE_TYPE:return compare_sequences((SEQUENCE)(ob1 & PTR_MASK), (SEQUENCE)(ob2 & PTR_MASK));
+		case BUILDER_TYPE: return compare_builders((BUILDER)(ob1 & PTR_MASK), (BUILDER)(ob2 & PTR_MASK));
+		case BYTES_TYPE:   return compare_bytes((BYTES)(ob1 & PTR_MASK), (BYTES)(ob2 & PTR_MASK));
 		default:           return 0; // really shouldn't happen
 		/* NOTE
 		 * The garbage collector *will* reorder objects in memory,
@@ -1165,7 +1859,10 @@ __attribute__((hot))
 static STRING unbox_STRING(ANY b)
 {
 	if likely((b & STRING_TYPE) == STRING_TYPE)
+	{
+		if unlikely(!flat_string(b)) return view_of(b) ? view_flatten(view_of(b)) : short_flatten(b);
 		return (STRING)(b & UNALIGNED_PTR_MASK);
+	}
 	type_error("string", b);
 	#ifdef __TINYC__
 	return NULL;
@@ -1293,24 +1990,164 @@ static TABLE early_TABLE(BOX box)
 }
 
 __attribute__((hot))
-static LIST early_LIST(BOX box)
+static ANY box_ARRAY(ARRAY a)
 {
-	ANY a = *box;
-	if likely (a != NIL) return (LIST) (a & PTR_MASK);
-	throw_error("Used before definition");
+	return ARRAY_TYPE | (ANY)a;
+}
+
+__attribute__((hot))
+static ARRAY unbox_ARRAY(ANY b)
+{
+	if likely((b & TYPE_MASK) == ARRAY_TYPE)
+		return (ARRAY)(b & PTR_MASK);
+	type_error("array", b);
 	#ifdef __TINYC__
 	return NULL;
 	#endif
 }
 
 __attribute__((hot))
-static NUMBER early_NUMBER(BOX box)
+static ARRAY early_ARRAY(BOX box)
 {
 	ANY a = *box;
-	if likely (a != NIL) return *(NUMBER*)&a;
+	if likely (a != NIL) return (ARRAY) (a & PTR_MASK);
 	throw_error("Used before definition");
 	#ifdef __TINYC__
-	return 0;
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static ANY box_VECTOR(VECTOR v)
+{
+	return VECTOR_TYPE | (ANY)v;
+}
+
+__attribute__((hot))
+static VECTOR unbox_VECTOR(ANY b)
+{
+	if likely((b & TYPE_MASK) == VECTOR_TYPE)
+		return (VECTOR)(b & PTR_MASK);
+	type_error("vector", b);
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static VECTOR early_VECTOR(BOX box)
+{
+	ANY a = *box;
+	if likely (a != NIL) return (VECTOR) (a & PTR_MASK);
+	throw_error("Used before definition");
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static ANY box_SEQUENCE(SEQUENCE s)
+{
+	return SEQUENCE_TYPE | (ANY)s;
+}
+
+__attribute__((hot))
+static SEQUENCE unbox_SEQUENCE(ANY b)
+{
+	if likely((b & TYPE_MASK) == SEQUENCE_TYPE)
+		return (SEQUENCE)(b & PTR_MASK);
+	type_error("sequence", b);
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static SEQUENCE early_SEQUENCE(BOX box)
+{
+	ANY a = *box;
+	if likely (a != NIL) return (SEQUENCE) (a & PTR_MASK);
+	throw_error("Used before definition");
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static ANY box_BUILDER(BUILDER b)
+{
+	return BUILDER_TYPE | (ANY)b;
+}
+
+__attribute__((hot))
+static BUILDER unbox_BUILDER(ANY b)
+{
+	if likely((b & TYPE_MASK) == BUILDER_TYPE)
+		return (BUILDER)(b & PTR_MASK);
+	type_error("builder", b);
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static BUILDER early_BUILDER(BOX box)
+{
+	ANY a = *box;
+	if likely (a != NIL) return (BUILDER) (a & PTR_MASK);
+	throw_error("Used before definition");
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static ANY box_BYTES(BYTES b)
+{
+	return BYTES_TYPE | (ANY)b;
+}
+
+__attribute__((hot))
+static BYTES unbox_BYTES(ANY b)
+{
+	if likely((b & TYPE_MASK) == BYTES_TYPE)
+		return (BYTES)(b & PTR_MASK);
+	type_error("bytes", b);
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static BYTES early_BYTES(BOX box)
+{
+	ANY a = *box;
+	if likely (a != NIL) return (BYTES) (a & PTR_MASK);
+	throw_error("Used before definition");
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static LIST early_LIST(BOX box)
+{
+	ANY a = *box;
+	if likely (a != NIL) return (LIST) (a & PTR_MASK);
+	throw_error("Used before definition");
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+__attribute__((hot))
+static NUMBER early_NUMBER(BOX box)
+{
+	ANY a = *box;
+	if likely (a != NIL) return *(NUMBER*)&a;
+	throw_error("Used before definition");
+	#ifdef __TINYC__
+	return 0;
 	#endif
 }
 
@@ -1340,7 +2177,7 @@ __attribute__((hot))
 static STRING early_STRING(BOX box)
 {
 	ANY a = *box;
-	if likely (a != NIL) return (STRING) (a & UNALIGNED_PTR_MASK);
+	if likely (a != NIL) return unbox_STRING(a);
 	throw_error("Used before definition");
 	#ifdef __TINYC__
 	return NULL;
@@ -1542,6 +2379,7 @@ static void gc_collect_from_heap(gc_heap* roots, gc_heap* source, gc_heap* dest)
 
 static bool any_is_ptr(ANY a)
 {
+	if ((a & SHORT_STRING_TYPE) == SHORT_STRING_TYPE) return false;
 	switch (type_of(a))
 	{
 		case NIL: case NUMBER_TYPE: case BOOLEAN_TYPE: case SYMBOL_TYPE: return false;
@@ -1608,6 +2446,7 @@ static void gc_collect_cascade(int n)
 	gc_collect_from_heap(&mutable_space[mz], &space[n], &space[n+1]);
 	gc_collect_from_stacks(&space[n], &space[n+1]);
 	gc_clear_heap(&space[n]);
+	hash_epoch++;
 /*
 	clock_t end = clock();
 	float mseconds = (float)(end - start) * 1000 / CLOCKS_PER_SEC;
@@ -1622,21 +2461,254 @@ static void gc_collect_mutable(void)
 		gc_collect_from_heap(&space[i], &mutable_space[mz], &mutable_space[!mz]); // Mutable memory can be referenced by main memory. TODO combine this with main memory gc
 	gc_clear_heap(&mutable_space[mz]);
 	mz = !mz;
+	hash_epoch++;
+}
+
+static char* gc_malloc_string(size_t bytes)
+{
+	// Strings in the heap carry a header with their length, so the caller must fill exactly that many bytes.
+	string_header* h = gc_malloc(sizeof *h + bytes + 1);
+	h->bytes = bytes;
+	h->chars = STRING_CHARS_UNKNOWN;
+	char* str = (char*)(h + 1);
+	str[bytes] = '\0';
+	return str;
+}
+
+static string_header* string_header_of(STRING str)
+{
+	// Literals, the general purpose buffer, and tails of other strings have no header.
+	// Every string in the heap comes from gc_malloc_string, so a string whose allocation starts
+	// two words before it is one with a header, and a tail never lines up like that.
+	if ((uintptr_t)str & 7) return NULL;
+	for (int i = 0 ; i < gc_num_heaps ; ++i)
+	{
+		size_t index = (uintptr_t*)str - space[i].start;
+		if (index - 2 >= space[i].alloc) continue;
+		if ((gc_bitmap_get(&space[i], index - 2) & ALLOC)
+			&& !(gc_bitmap_get(&space[i], index - 1) & ALLOC)
+			&& !(gc_bitmap_get(&space[i], index) & ALLOC))
+			return (string_header*)str - 1;
+		return NULL;
+	}
+	return NULL;
+}
+
+static size_t string_bytes(STRING str)
+{
+	string_header* h = string_header_of(str);
+	return h ? h->bytes : strlen(str);
+}
+
+static size_t string_chars(STRING str)
+{
+	string_header* h = string_header_of(str);
+	if (h && h->chars != STRING_CHARS_UNKNOWN) return h->chars;
+	size_t chars = count_chars(str, h ? h->bytes : strlen(str));
+	if (h) h->chars = chars;
+	return chars;
+}
+
+#ifndef __TINYC__
+typedef uint8_t byte_lanes __attribute__((vector_size(32), aligned(1)));
+#endif
+
+static size_t ascii_prefix(const char* s, size_t bytes)
+{
+	// How many bytes at the start of s are ASCII, checked a vector at a time.
+	size_t i = 0;
+	#ifndef __TINYC__
+	for ( ; i + sizeof(byte_lanes) <= bytes ; i += sizeof(byte_lanes))
+	{
+		byte_lanes v;
+		memcpy(&v, s + i, sizeof v);
+		uint64_t w[sizeof v / sizeof(uint64_t)];
+		memcpy(w, &v, sizeof v);
+		if ((w[0] | w[1] | w[2] | w[3]) & 0x8080808080808080ull) break;
+	}
+	#endif
+	while (i < bytes && !((uint8_t)s[i] & 0x80)) ++i;
+	return i;
+}
+
+static size_t utf8_continuations(uint8_t c)
+{
+	// How many continuation bytes (10xxxxxx) a lead byte expects.
+	return c < 0xc0 ? 0 : c < 0xe0 ? 1 : c < 0xf0 ? 2 : c < 0xf5 ? 3 : 0;
+}
+
+static bool utf8_continues(const char* s, size_t i)
+{
+	// Whether byte i is a continuation byte that an earlier lead byte takes, rather than a character by itself.
+	if (((uint8_t)s[i] & 0xc0) != 0x80) return false;
+	for (size_t k = 1 ; k <= 3 && k <= i ; ++k)
+		if (((uint8_t)s[i - k] & 0xc0) != 0x80) return utf8_continuations(s[i - k]) >= k;
+	return false;
+}
+
+static size_t utf8_chars(const char* s, size_t bytes)
+{
+	// Counts characters by the same rule char_bytes steps over them, so invalid bytes are each a character.
+	// A continuation byte belongs to the lead byte up to three before it, if every byte in between is a continuation too.
+	size_t chars = 0;
+	size_t i = 0;
+	for ( ; i < bytes && i < 3 ; ++i) chars += !utf8_continues(s, i);
+	#ifndef __TINYC__
+	while (i + sizeof(byte_lanes) <= bytes)
+	{
+		// Each lane counts up to 255 characters before they're added up.
+		byte_lanes counts = {0};
+		for (int k = 0 ; k < 255 && i + sizeof(byte_lanes) <= bytes ; ++k, i += sizeof(byte_lanes))
+		{
+			byte_lanes v, p1, p2, p3;
+			memcpy(&v, s + i, sizeof v);
+			memcpy(&p1, s + i - 1, sizeof p1);
+			memcpy(&p2, s + i - 2, sizeof p2);
+			memcpy(&p3, s + i - 3, sizeof p3);
+			const byte_lanes c1 = (byte_lanes)((p1 & 0xc0) == 0x80);
+			const byte_lanes c2 = (byte_lanes)((p2 & 0xc0) == 0x80);
+			const byte_lanes taken = (byte_lanes)((v & 0xc0) == 0x80)
+				& (((byte_lanes)(p1 >= 0xc0) & (byte_lanes)(p1 < 0xf5))
+					| (c1 & (byte_lanes)(p2 >= 0xe0) & (byte_lanes)(p2 < 0xf5))
+					| (c1 & c2 & (byte_lanes)(p3 >= 0xf0) & (byte_lanes)(p3 < 0xf5)));
+			counts += ~taken & 1;
+		}
+		for (size_t k = 0 ; k < sizeof(byte_lanes) ; ++k) chars += counts[k];
+	}
+	#endif
+	for ( ; i < bytes ; ++i) chars += !utf8_continues(s, i);
+	return chars;
+}
+
+static size_t count_chars(const char* s, size_t bytes)
+{
+	// ASCII is the same in every locale, so the locale only matters after the first other byte.
+	size_t i = ascii_prefix(s, bytes);
+	if (i == bytes) return bytes;
+	if (utf8_locale) return i + utf8_chars(s + i, bytes - i);
+	size_t chars = i;
+	for ( ; i < bytes ; ++chars) i += char_bytes(s + i, bytes - i);
+	return chars;
+}
+
+static size_t char_bytes(const char* s, size_t bytes)
+{
+	// Invalid characters are skipped one byte at a time instead of looping forever.
+	if likely(!((uint8_t)*s & 0x80)) return 1;
+	if (utf8_locale)
+	{
+		// A lead byte takes as many of the continuation bytes after it as it expects, which is how utf8_chars counts.
+		size_t n = 1;
+		while (n <= utf8_continuations(*s) && n < bytes && ((uint8_t)s[n] & 0xc0) == 0x80) ++n;
+		return n;
+	}
+	int n = mblen(s, bytes < (size_t)MB_CUR_MAX ? bytes : (size_t)MB_CUR_MAX);
+	return n > 0 ? n : 1;
+}
+
+static string_view* view_of(ANY a)
+{
+	return (a & SHORT_STRING_TYPE) == VIEW_TYPE ? (string_view*)(a & PTR_MASK) : NULL;
+}
+
+static bool flat_string(ANY a)
+{
+	// Whether a string is a plain pointer to NUL terminated bytes, rather than a view or short string.
+	return (a & VIEW_TYPE) != VIEW_TYPE;
+}
+
+static ANY short_string(const char* s, size_t bytes)
+{
+	ANY a = SHORT_STRING_TYPE;
+	memcpy(&a, s, bytes);
+	return a;
+}
+
+static STRING short_flatten(ANY a)
+{
+	// Single ASCII characters come from a table, so only longer short strings allocate.
+	static char ascii_chars[128][2];
+	size_t bytes = strnlen((char*)&a, SHORT_STRING_MAX);
+	if (bytes == 0) return "";
+	if (bytes == 1 && !((uint8_t)a & 0x80))
+	{
+		ascii_chars[(uint8_t)a][0] = (char)a;
+		return ascii_chars[(uint8_t)a];
+	}
+	char* str = gc_malloc_string(bytes);
+	memcpy(str, &a, bytes);
+	return str;
+}
+
+static size_t view_chars(string_view* v)
+{
+	if (v->chars == STRING_CHARS_UNKNOWN)
+	{
+		v->chars = count_chars(v->start, v->bytes);
+	}
+	return v->chars;
+}
+
+static STRING view_flatten(string_view* v)
+{
+	// Only done when C needs the string to be NUL terminated.
+	char* str = gc_malloc_string(v->bytes);
+	memcpy(str, v->start, v->bytes);
+	((string_header*)str - 1)->chars = v->chars;
+	return str;
+}
+
+static ANY make_view(const char* start, size_t bytes, size_t chars)
+{
+	// Short views are copied into a short string, and those that run to the end of their string are just pointers into it.
+	// Short strings come first, since start might point into another short string.
+	// The general purpose buffer gets reused, so anything longer in it has to be copied out.
+	if (bytes <= SHORT_STRING_MAX) return short_string(start, bytes);
+	if (in_general_purpose_buffer(start))
+	{
+		char* str = memcpy(gc_malloc_string(bytes), start, bytes);
+		((string_header*)str - 1)->chars = chars;
+		return box_STRING(str);
+	}
+	if (!start[bytes]) return box_STRING(start);
+	string_view* v = gc_malloc(sizeof *v);
+	v->start = start;
+	v->bytes = bytes;
+	v->chars = chars;
+	gc_mark_ptr((void*)&v->start);
+	return VIEW_TYPE | (ANY)v;
+}
+
+static STRING string_span(const ANY* a, size_t* bytes)
+{
+	// The bytes of any kind of string, which are only NUL terminated for flat ones.
+	// Short strings are read straight out of *a, so it has to outlive the result.
+	if (flat_string(*a))
+	{
+		STRING str = (STRING)(*a & UNALIGNED_PTR_MASK);
+		*bytes = string_bytes(str);
+		return str;
+	}
+	string_view* v = view_of(*a);
+	if (v)
+	{
+		*bytes = v->bytes;
+		return v->start;
+	}
+	*bytes = strnlen((char*)a, SHORT_STRING_MAX);
+	return (STRING)a;
 }
 
 static char* gc_strdup(char* src)
 {
 	const size_t len = strlen(src);
-	return memcpy(gc_malloc(len + 1), src, len + 1);
+	return memcpy(gc_malloc_string(len), src, len);
 }
 
 static char* gc_strndup(char* src, size_t bytes)
 {
-	const size_t len = strlen(src);
-	if (len < bytes) bytes = len;
-	char* dest = gc_malloc(bytes + 1);
-	dest[bytes] = '\0';
-	return memcpy(dest, src, bytes);
+	bytes = strnlen(src, bytes);
+	return memcpy(gc_malloc_string(bytes), src, bytes);
 }
 
 static ANY ___if(BOOLEAN cond, ANY a, ANY b)
@@ -1644,27 +2716,29 @@ static ANY ___if(BOOLEAN cond, ANY a, ANY b)
 	return cond ? a : b;
 }
 
-static void ___put(ANY a)             { assert_impure(); fputs(___show(a), stdout); fflush(stdout);         }
-static void ___put_NUMBER(NUMBER a)   { assert_impure(); fputs(___show_NUMBER(a), stdout); fflush(stdout);  }
-static void ___put_LIST(LIST a)       { assert_impure(); fputs(___show_LIST(a), stdout); fflush(stdout);    }
-static void ___put_TABLE(TABLE a)     { assert_impure(); fputs(___show_TABLE(a), stdout); fflush(stdout);   }
-static void ___put_IO(IO a)           { assert_impure(); fputs(___show_IO(a), stdout); fflush(stdout);      }
-static void ___put_BLOCK(BLOCK a)     { assert_impure(); fputs(___show_BLOCK(a), stdout); fflush(stdout);   }
-static void ___put_STRING(STRING a)   { assert_impure(); fputs(___show_STRING(a), stdout); fflush(stdout);  }
-static void ___put_SYMBOL(SYMBOL a)   { assert_impure(); fputs(___show_SYMBOL(a), stdout); fflush(stdout);  }
-static void ___put_BOOLEAN(BOOLEAN a) { assert_impure(); fputs(___show_BOOLEAN(a), stdout); fflush(stdout); }
-static void ___put_BOX(BOX a)         { assert_impure(); fputs(___show_BOX(a), stdout);                     }
-
-static void ___print(ANY a)             { assert_impure(); puts(___show(a));         }
-static void ___print_NUMBER(NUMBER a)   { assert_impure(); puts(___show_NUMBER(a));  }
-static void ___print_LIST(LIST a)       { assert_impure(); puts(___show_LIST(a));    }
-static void ___print_TABLE(TABLE a)     { assert_impure(); puts(___show_TABLE(a));   }
-static void ___print_IO(IO a)           { assert_impure(); puts(___show_IO(a));      }
-static void ___print_BLOCK(BLOCK a)     { assert_impure(); puts(___show_BLOCK(a));   }
-static void ___print_STRING(STRING a)   { assert_impure(); puts(___show_STRING(a));  }
-static void ___print_SYMBOL(SYMBOL a)   { assert_impure(); puts(___show_SYMBOL(a));  }
-static void ___print_BOOLEAN(BOOLEAN a) { assert_impure(); puts(___show_BOOLEAN(a)); }
-static void ___print_BOX(BOX a)         { assert_impure(); puts(___show_BOX(a));     }
+static void ___put(ANY a)             { assert_impure(); put_object(a, stdout);              }
+static void ___put_NUMBER(NUMBER a)   { assert_impure(); put_object(box_NUMBER(a), stdout);  }
+static void ___put_LIST(LIST a)       { assert_impure(); put_object(box_LIST(a), stdout);    }
+static void ___put_TABLE(TABLE a)     { assert_impure(); put_object(box_TABLE(a), stdout);   }
+static void ___put_IO(IO a)           { assert_impure(); put_object(box_IO(a), stdout);      }
+static void ___put_BLOCK(BLOCK a)     { assert_impure(); put_object(box_BLOCK(a), stdout);   }
+static void ___put_STRING(STRING a)   { assert_impure(); put_object(box_STRING(a), stdout);  }
+static void ___put_SYMBOL(SYMBOL a)   { assert_impure(); put_object(box_SYMBOL(a), stdout);  }
+static void ___put_BOOLEAN(BOOLEAN a) { assert_impure(); put_object(box_BOOLEAN(a), stdout); }
+static void ___put_BOX(BOX a)         { assert_impure(); put_object(box_BOX(a), stdout);     }
+
+static void ___flush(void) { assert_impure(); fflush(stdout); }
+
+static void ___print(ANY a)             { assert_impure(); put_object(a, stdout); putchar('\n');              }
+static void ___print_NUMBER(NUMBER a)   { assert_impure(); put_object(box_NUMBER(a), stdout); putchar('\n');  }
+static void ___print_LIST(LIST a)       { assert_impure(); put_object(box_LIST(a), stdout); putchar('\n');    }
+static void ___print_TABLE(TABLE a)     { assert_impure(); put_object(box_TABLE(a), stdout); putchar('\n');   }
+static void ___print_IO(IO a)           { assert_impure(); put_object(box_IO(a), stdout); putchar('\n');      }
+static void ___print_BLOCK(BLOCK a)     { assert_impure(); put_object(box_BLOCK(a), stdout); putchar('\n');   }
+static void ___print_STRING(STRING a)   { assert_impure(); put_object(box_STRING(a), stdout); putchar('\n');  }
+static void ___print_SYMBOL(SYMBOL a)   { assert_impure(); put_object(box_SYMBOL(a), stdout); putchar('\n');  }
+static void ___print_BOOLEAN(BOOLEAN a) { assert_impure(); put_object(box_BOOLEAN(a), stdout); putchar('\n'); }
+static void ___print_BOX(BOX a)         { assert_impure(); put_object(box_BOX(a), stdout); putchar('\n');     }
 
 static NUMBER ___P(NUMBER a, NUMBER b) { return a + b; } // Add cannot produce NaN.
 static NUMBER ___M(NUMBER a, NUMBER b) { return a * b; }
@@ -1703,6 +2777,7 @@ static BOOLEAN ___and(BOOLEAN a, BOOLEAN b) { return a && b; }
 static BOOLEAN ___xor(BOOLEAN a, BOOLEAN b) { return a ^ b;  }
 static BOOLEAN ___not(BOOLEAN a)            { return a ? false : true; }
 static BOOLEAN ___EE(ANY a, ANY b) { return 0 == compare_objects(a,b); }
+static NUMBER ___hash(ANY a) { return (NUMBER)(hash_object(a) & ((1ull << 53) - 1)); } // Exact as a double.
 static BOOLEAN ___G(NUMBER a, NUMBER b)  { return a < b; }
 static BOOLEAN ___L(NUMBER a, NUMBER b)  { return a > b; }
 static BOOLEAN ___GE(NUMBER a, NUMBER b) { return a <= b; }
@@ -1715,6 +2790,11 @@ static BOOLEAN ___booleanQ(ANY a) { return (a & TYPE_MASK)   == BOOLEAN_TYPE; }
 static BOOLEAN ___symbolQ(ANY a)  { return (a & SYMBOL_TYPE) == SYMBOL_TYPE;  }
 static BOOLEAN ___ioQ(ANY a)      { return (a & TYPE_MASK)   == IO_TYPE;      }
 static BOOLEAN ___tableQ(ANY a)   { return (a & TYPE_MASK)   == TABLE_TYPE;   }
+static BOOLEAN ___arrayQ(ANY a)   { return (a & TYPE_MASK)   == ARRAY_TYPE;   }
+static BOOLEAN ___vectorQ(ANY a)  { return (a & TYPE_MASK)   == VECTOR_TYPE;  }
+static BOOLEAN ___sequenceQ(ANY a){ return (a & TYPE_MASK)   == SEQUENCE_TYPE;}
+static BOOLEAN ___builderQ(ANY a) { return (a & TYPE_MASK)   == BUILDER_TYPE; }
+static BOOLEAN ___bytesQ(ANY a)   { return (a & TYPE_MASK)   == BYTES_TYPE;   }
 static BOOLEAN ___integerQ(ANY a) { return ___numberQ(a) && unbox_NUMBER(a) == floor(unbox_NUMBER(a)); }
 static BOOLEAN ___zeroQ(ANY a)    { return ___numberQ(a) && unbox_NUMBER(a) == 0; }
 
@@ -1727,6 +2807,11 @@ static BOOLEAN ___booleanX(BOOLEAN a){ return a; }
 static SYMBOL  ___symbolX(SYMBOL a)  { return a; }
 static IO      ___ioX(IO a)          { return a; }
 static TABLE   ___tableX(TABLE a)    { return a; }
+static ARRAY   ___arrayX(ARRAY a)    { return a; }
+static VECTOR  ___vectorX(VECTOR a)  { return a; }
+static SEQUENCE ___sequenceX(SEQUENCE a) { return a; }
+static BUILDER ___builderX(BUILDER a)  { return a; }
+static BYTES   ___bytesX(BYTES a)      { return a; }
 
 //static BOOLEAN ___match(ANY patt, ANY obj) { return match_objects(patt,obj); }
 
@@ -1744,16 +2829,17 @@ static LIST ___rest_LIST(LIST lst)
 	return lst->next;
 }
 
-static STRING ___first_STRING(STRING str)
+static ANY ___first_STRING(STRING str)
 {
+	// Characters are never longer than a short string, so this doesn't allocate.
 	if unlikely(!*str) throw_error("empty string is invalid");
-	return gc_strndup((char*)str, mblen(str, MB_CUR_MAX));
+	return short_string(str, char_bytes(str, MB_CUR_MAX));
 }
 
 static STRING ___rest_STRING(STRING str)
 {
 	if unlikely(!*str) throw_error("empty string is invalid");
-	return str + mblen(str, MB_CUR_MAX);
+	return str + char_bytes(str, MB_CUR_MAX);
 }
 
 static ANY ___first(ANY a)
@@ -1761,8 +2847,13 @@ static ANY ___first(ANY a)
 	switch(type_of(a))
 	{
 		case LIST_TYPE:   return ___first_LIST((LIST)(a & PTR_MASK));
-		case STRING_TYPE: return box_STRING(___first_STRING((STRING)(a & UNALIGNED_PTR_MASK)));
-		default: type_error("string or list", a);
+		case STRING_TYPE:
+			{
+				size_t bytes;
+				return ___first_STRING(string_span(&a, &bytes));
+			}
+		case SEQUENCE_TYPE: return ___first_SEQUENCE((SEQUENCE)(a & PTR_MASK));
+		default: type_error("string or list or sequence", a);
 	}
 #ifdef __TINYC__
 	return NIL;
@@ -1774,8 +2865,17 @@ static ANY ___rest(ANY a)
 	switch(type_of(a))
 	{
 		case LIST_TYPE:   return box_LIST(___rest_LIST((LIST)(a & PTR_MASK)));
-		case STRING_TYPE: return box_STRING(___rest_STRING((STRING)(a & UNALIGNED_PTR_MASK)));
-		default: type_error("string or list", a);
+		case STRING_TYPE:
+			{
+				if (flat_string(a)) return box_STRING(___rest_STRING((STRING)(a & UNALIGNED_PTR_MASK)));
+				size_t bytes;
+				STRING str = string_span(&a, &bytes);
+				if unlikely(!bytes) throw_error("empty string is invalid");
+				size_t n = char_bytes(str, bytes);
+				return make_view(str + n, bytes - n, STRING_CHARS_UNKNOWN);
+			}
+		case SEQUENCE_TYPE: return box_SEQUENCE(___rest_SEQUENCE((SEQUENCE)(a & PTR_MASK)));
+		default: type_error("string or list or sequence", a);
 	}
 #ifdef __TINYC__
 	return NIL;
@@ -1815,9 +2915,10 @@ static BOOLEAN ___emptyQ(ANY a)
 	switch (type_of(a))
 	{
 		case LIST_TYPE: return ___emptyQ_LIST(unbox_LIST(a));
-		case STRING_TYPE: return ___emptyQ_STRING(unbox_STRING(a));
+		case STRING_TYPE: return flat_string(a) ? ___emptyQ_STRING(unbox_STRING(a)) : a == SHORT_STRING_TYPE; // Views are never empty.
 		case TABLE_TYPE: return ___emptyQ_TABLE(unbox_TABLE(a));
-		default: type_error("List or String or Table", a);
+		case SEQUENCE_TYPE: return ___emptyQ_SEQUENCE(unbox_SEQUENCE(a));
+		default: type_error("List or String or Table or Sequence", a);
 	}
 	#ifdef __TINYC__
 	return 0;
@@ -1840,62 +2941,134 @@ static LIST ___list(BLOCK expr)
 	return lst;
 }
 
-static STRING ___substring(NUMBER startf, NUMBER endf, STRING str)
+static ANY ___substring(NUMBER startf, NUMBER endf, ANY a)
 {
-	// O(end).
-	// Only allocates a new string if it has to.
-	/* TODO: Would it be better to have a simpler and more minimalist set of string functions, like lists do?
-	 * The only real difference between NULL terminated strings and linked lists is that appending to strings is harder.
-	 * Maybe also a 'Join N Str1 Str2 Str3 ... StrN' function.
-	 */
+	// O(1) for ASCII strings with a header and views of them, otherwise O(end).
+	// Returns a view of the string, so nothing is copied.
+	if unlikely(!___stringQ(a)) type_error("string", a);
 	size_t start	= startf;
 	size_t end		= endf;
-	if unlikely(start != startf || end != endf || start > end) goto invalid_range;
-	size_t str_size = 0;
-	end -= start;
-	for (;start != 0; --start)
+	if unlikely(startf < 0 || start != startf || end != endf || start > end) goto invalid_range;
+	STRING str;
+	size_t bytes = SIZE_MAX; // Plain strings can also end at a NUL.
+	size_t chars = STRING_CHARS_UNKNOWN;
+	if (!flat_string(a))
 	{
-		if unlikely(!*str) goto invalid_range;
-		str += mblen(str, MB_CUR_MAX);
+		str = string_span(&a, &bytes);
+		chars = view_of(a) ? view_chars(view_of(a)) : count_chars(str, bytes);
 	}
-	for (;end != 0; --end)
+	else
 	{
-		if unlikely(str[str_size] == '\0') goto invalid_range;
-		str_size += mblen(str+str_size, MB_CUR_MAX);
+		str = (STRING)(a & UNALIGNED_PTR_MASK);
+		string_header* h = string_header_of(str);
+		if (h) bytes = h->bytes, chars = string_chars(str);
 	}
-	if unlikely(str[str_size] == '\0')
+	if (chars == bytes && bytes != SIZE_MAX)
 	{
-		// We don't need to make a new string here.
-		return str;
+		// All characters are single bytes, which only a known length can tell.
+		if unlikely(end > bytes) goto invalid_range;
+		return make_view(str + start, end - start, end - start);
 	}
-	return gc_strndup((char*)str, str_size + 1);
+	size_t i = 0;
+	for (size_t n = 0 ; n != start ; ++n)
+	{
+		if unlikely(i == bytes || !str[i]) goto invalid_range;
+		i += char_bytes(str + i, MB_CUR_MAX);
+	}
+	const size_t from = i;
+	for (size_t n = start ; n != end ; ++n)
+	{
+		if unlikely(i == bytes || !str[i]) goto invalid_range;
+		i += char_bytes(str + i, MB_CUR_MAX);
+	}
+	return make_view(str + from, i - from, end - start);
 invalid_range:
 	throw_error_fmt("Invalid range %.14g..%.14g", startf, endf);
 	#ifdef __TINYC__
-	return NULL;
+	return NIL;
 	#endif
 }
 
 
+static char* line_buffer = NULL; // Kept between calls to read_line, and grown as needed by getline.
+static size_t line_buffer_size = 0;
+
+static ssize_t read_line(FILE* fp)
+{
+	// Reads a line into line_buffer, returning its length including any newline, or -1 at the end of the file.
+	return getline(&line_buffer, &line_buffer_size, fp);
+}
+
+static ANY line_string(ssize_t bytes)
+{
+	// Copies a line out of line_buffer, without the newline.
+	if (bytes && line_buffer[bytes-1] == '\n') --bytes;
+	if (bytes <= SHORT_STRING_MAX) return short_string(line_buffer, bytes);
+	return box_STRING(memcpy(gc_malloc_string(bytes), line_buffer, bytes));
+}
+
 static STRING ___input(void)
 {
 	// Read user input to a string.
 	assert_impure();
-	size_t size = 0;
-	char* buf;
-	size_t chars = getline(&buf, &size, stdin);
-	char* ret = gc_strndup(buf, chars-1); // Don't copy trailing newline.
-	free(buf);
-	return ret;
+	fflush(stdout); // Show any prompt first, even when stdout isn't a terminal.
+	ssize_t bytes = read_line(stdin);
+	if (bytes < 0) return "";
+	if (line_buffer[bytes-1] == '\n') --bytes; // Don't copy trailing newline.
+	return memcpy(gc_malloc_string(bytes), line_buffer, bytes);
+}
+
+static bool parse_decimal(const char* s, const char* end, NUMBER* n)
+{
+	// Parses the common case of a short decimal without strtod.
+	// When the digits and the power of ten are both exact doubles, one multiply or divide rounds correctly (Clinger's fast path).
+	// Anything else, including hex, infinities and long or extreme numbers, is left to strtod.
+	bool negative = false;
+	if (s != end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+	uint64_t w = 0;
+	int digits = 0, exponent = 0;
+	for ( ; s != end && (unsigned)(*s - '0') < 10 ; ++s, ++digits) w = w * 10 + (*s - '0');
+	if (s != end && *s == '.')
+		for (++s ; s != end && (unsigned)(*s - '0') < 10 ; ++s, ++digits, --exponent) w = w * 10 + (*s - '0');
+	if (!digits || digits > 19) return false;
+	if (s != end && (*s == 'e' || *s == 'E'))
+	{
+		bool negative_exponent = false;
+		if (++s != end && (*s == '-' || *s == '+')) negative_exponent = *s++ == '-';
+		if (s == end || (unsigned)(*s - '0') >= 10) return false;
+		int e = 0;
+		for ( ; s != end && (unsigned)(*s - '0') < 10 ; ++s) if (e < 10000) e = e * 10 + (*s - '0');
+		exponent += negative_exponent ? -e : e;
+	}
+	if (s != end || w > (1ull << 53)) return false;
+	double d = w;
+	if (exponent < 0)
+	{
+		if (exponent < -22) return false;
+		d /= powers_of_ten[-exponent];
+	}
+	else if (exponent > 22)
+	{
+		// Extra zeros can go on the digits, as long as they stay exact.
+		if (exponent > 22 + 15) return false;
+		d *= powers_of_ten[exponent - 22];
+		if (d > (1ull << 53)) return false;
+		d *= powers_of_ten[22];
+	}
+	else d *= powers_of_ten[exponent];
+	*n = negative ? -d : d;
+	return true;
 }
 
 static NUMBER ___number(STRING str)
 {
 	// casts string to number.
+	NUMBER num;
+	if (parse_decimal(str, str + string_bytes(str), &num)) return num;
 	char* end;
-	NUMBER num = strtod(str, &end);
+	num = strtod(str, &end);
 	if (end == str || *end != '\0') goto cannot_parse;
-	return num;
+	return isnan(num) ? NAN : num; // strtod keeps payloads like nan(0x...), which could pass for boxed values.
 cannot_parse:
 	throw_error_fmt("Cannot parse '%.32s' to a number", str);
 	#ifdef __TINYC__
@@ -1937,6 +3110,7 @@ static void ___stop(void)
 {
 	assert_impure();
 	// Don't check stack length, because it probably wont be empty.
+	fflush(stdout);
 	exit(EXIT_SUCCESS);
 }
 
@@ -1950,14 +3124,14 @@ static NUMBER ___ordinal(STRING str)
 	return chr;
 }
 
-static STRING ___character(NUMBER d)
+static ANY ___character(NUMBER d)
 {
 	const wchar_t i = d;
-	char* const str = gc_malloc (MB_CUR_MAX + 1);
-	if unlikely(i != d || wctomb(str, i) == -1)
+	char str[MB_LEN_MAX];
+	int len;
+	if unlikely(i != d || (len = wctomb(str, i)) == -1)
 		throw_error_fmt("Cannot convert %.14g to UTF8 character", d);
-	str[mblen(str, MB_CUR_MAX)] = '\0';
-	return str;
+	return short_string(str, strnlen(str, len)); // Character 0 is the empty string.
 }
 
 static NUMBER ___floor(NUMBER a)
@@ -2013,66 +3187,117 @@ static BLOCK ___precompute(BLOCK blk)
 
 static STRING ___show(ANY o)
 {
-	if ((o & STRING_TYPE) == STRING_TYPE || (o & SYMBOL_TYPE) == SYMBOL_TYPE)
-		return (STRING)(o & UNALIGNED_PTR_MASK);
+	if ((o & STRING_TYPE) == STRING_TYPE) return unbox_STRING(o);
+	if ((o & SYMBOL_TYPE) == SYMBOL_TYPE) return (STRING)(o & UNALIGNED_PTR_MASK);
 	show_object(o, general_purpose_buffer, NULL);
 	return general_purpose_buffer;
 }
 
-static LIST ___split(STRING sep, STRING str)
+static const char* find_bytes(const char* str, size_t bytes, const char* sub, size_t sub_bytes)
 {
-	if (!*sep) throw_error("Seperator cannot be empty");
-	LIST lst1 = NULL;
-	size_t len = strlen(sep);
-	char* found;
-	while ((found = strstr(str, sep)))
-	{
-		found = strstr(str, sep);
-		if (found != str)
-		{
-			char* item = gc_malloc(found - str + 1);
-			memcpy(item, str, found - str);
-			item[found - str] = '\0';
-			lst1 = ___push(box_STRING(item), lst1);
-		}
-		str = found + len;
-	}
-	if (*str) lst1 = ___push(box_STRING(str), lst1);
+	// memchr is vectorised and memmem uses Two-Way (or better) in any decent libc, so they do the searching.
+	if (sub_bytes == 1) return memchr(str, *sub, bytes);
+	return memmem(str, bytes, sub, sub_bytes);
+}
+
+static LIST ___split(STRING sep, ANY a)
+{
+	// Pieces are views of the string, and go on the stack as they're found so the list can be built from the end.
+	if unlikely(!___stringQ(a)) type_error("string", a);
+	const size_t sep_bytes = string_bytes(sep);
+	if unlikely(!sep_bytes) throw_error("Separator cannot be empty");
+	size_t bytes;
+	STRING str = string_span(&a, &bytes);
+	STRING end = str + bytes;
+	ANYPTR pieces = stack.top;
+	for (STRING found ; (found = find_bytes(str, end - str, sep, sep_bytes)) ; str = found + sep_bytes)
+		if (found != str) push(make_view(str, found - str, STRING_CHARS_UNKNOWN));
+	if (str != end) push(make_view(str, end - str, STRING_CHARS_UNKNOWN));
 	LIST lst = NULL;
-	for (; lst1 ; lst1 = lst1->next) lst = ___push(lst1->object, lst);
+	for ( ; stack.top != pieces ; --stack.top) lst = ___push(stack.top[-1], lst);
 	return lst;
 }
 
-static STRING ___uppercase(STRING str)
+static NUMBER ___find(STRING sub, ANY a)
 {
-	char* converted = gc_strdup((char*)str);
-	int len = 0;
-	for (char* c = converted; *c; c += len)
+	// The index in characters of the first occurrence of sub, or -1 if there isn't one.
+	if unlikely(!___stringQ(a)) type_error("string", a);
+	size_t bytes;
+	STRING str = string_span(&a, &bytes);
+	STRING found = find_bytes(str, bytes, sub, string_bytes(sub));
+	return found ? (NUMBER)count_chars(str, found - str) : -1;
+}
+
+static BOOLEAN ___containsQ(STRING sub, ANY a)
+{
+	if unlikely(!___stringQ(a)) type_error("string", a);
+	size_t bytes;
+	STRING str = string_span(&a, &bytes);
+	return find_bytes(str, bytes, sub, string_bytes(sub)) != NULL;
+}
+
+static STRING ___replace(STRING old, STRING new, ANY a)
+{
+	// Counts the occurrences first, so the result is allocated once.
+	if unlikely(!___stringQ(a)) type_error("string", a);
+	const size_t old_bytes = string_bytes(old);
+	const size_t new_bytes = string_bytes(new);
+	if unlikely(!old_bytes) throw_error("Cannot replace the empty string");
+	size_t bytes;
+	STRING str = string_span(&a, &bytes);
+	STRING end = str + bytes;
+	size_t count = 0;
+	for (STRING s = str ; (s = find_bytes(s, end - s, old, old_bytes)) ; s += old_bytes) ++count;
+	char* replaced = gc_malloc_string(bytes - count * old_bytes + count * new_bytes);
+	char* out = replaced;
+	for (STRING found ; (found = find_bytes(str, end - str, old, old_bytes)) ; str = found + old_bytes)
 	{
-		wchar_t chr = 0;
-		len = mblen(c, MB_CUR_MAX);
-		mbtowc(&chr, c, len);
-		chr = towupper(chr);
-		wctomb(c, chr);
+		out = (char*)memcpy(out, str, found - str) + (found - str);
+		out = (char*)memcpy(out, new, new_bytes) + new_bytes;
 	}
-	return converted;
+	memcpy(out, str, end - str);
+	return replaced;
 }
 
-static STRING ___lowercase(STRING str)
+static void ascii_convert_case(char* out, const char* in, size_t bytes, char lo, char hi)
+{
+	// Flips the case bit of every letter between lo and hi, which compilers vectorise.
+	for (size_t i = 0 ; i < bytes ; ++i)
+		out[i] = in[i] ^ ((in[i] >= lo && in[i] <= hi) << 5);
+}
+
+static STRING convert_case(STRING str, wint_t (*convert)(wint_t), char lo, char hi)
 {
-	char* converted = gc_strdup((char*)str);
-	int len = 0;
-	for (char* c = converted; *c; c += len)
+	// ASCII runs are converted in bulk, and only the other characters go through the locale.
+	const size_t bytes = string_bytes(str);
+	char* converted = gc_malloc_string(bytes);
+	for (size_t i = 0 ; i < bytes ; )
 	{
+		size_t n = ascii_prefix(str + i, bytes - i);
+		ascii_convert_case(converted + i, str + i, n, lo, hi);
+		if ((i += n) == bytes) break;
 		wchar_t chr = 0;
-		len = mblen(c, MB_CUR_MAX);
-		mbtowc(&chr, c, len);
-		chr = towlower(chr);
-		wctomb(c, chr);
+		char buf[MB_LEN_MAX];
+		n = char_bytes(str + i, bytes - i);
+		// Characters whose other case is encoded with a different length are left alone.
+		if (mbtowc(&chr, str + i, n) == (int)n && wctomb(buf, convert(chr)) == (int)n)
+			memcpy(converted + i, buf, n);
+		else memcpy(converted + i, str + i, n);
+		i += n;
 	}
 	return converted;
 }
 
+static STRING ___uppercase(STRING str)
+{
+	return convert_case(str, towupper, 'a', 'z');
+}
+
+static STRING ___lowercase(STRING str)
+{
+	return convert_case(str, towlower, 'A', 'Z');
+}
+
 /*
 static BLOCK ___remember(BLOCK b)
 {
@@ -2288,6 +3513,13 @@ static IO ___open(SYMBOL m, STRING path)
 	io->path = path;
 	io->mode = mode;
 	io->file = fp;
+	io->buffer = NULL;
+	if (m != SYMread)
+	{
+		// stdio's buffers are a page, so writing many small strings costs a syscall every 4K without a bigger one.
+		io->buffer = malloc(WRITE_BUFFER_SIZE);
+		setvbuf(fp, io->buffer, _IOFBF, WRITE_BUFFER_SIZE);
+	}
 	gc_mark_ptr((void*)&io->path);
 	//gc_mark_ptr((void*)&io->mode);
 	//gc_mark_ptr((void*)&io->file);
@@ -2304,26 +3536,623 @@ static STRING ___readHfile(IO io)
 	if unlikely(fp == NULL) throw_error_fmt("Cannot open file '%s'", io->path);
 	struct stat st;
 	fstat(fileno(fp), &st);
-	char* const text = gc_malloc (st.st_size + 1);
+	char* const text = gc_malloc_string(st.st_size);
 	if (fread(text, sizeof(char), st.st_size, fp) != (unsigned long)st.st_size)
 		throw_error_fmt("Error reading file '%s'", io->path);
-	text[st.st_size] = '\0'; // Remove trailing eof.
 	return text;
 }
 
 static STRING ___readHline(IO io)
 {
 	assert_impure();
-	char* buf = (char*)general_purpose_buffer;
-	fgets(buf, INT_MAX, io->file);
-	return gc_strdup(buf); // this can only GC once so won't overwrite the buffer.
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	ssize_t bytes = read_line(io->file);
+	if (bytes < 0) return "";
+	return memcpy(gc_malloc_string(bytes), line_buffer, bytes);
 }
 
-static void ___close(IO io)
+static LIST ___lines(IO io)
 {
+	// Lines go on the stack as they're read, so the list can be built from the end.
 	assert_impure();
-	fclose(io->file);
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	ANYPTR lines = stack.top;
+	for (ssize_t bytes ; (bytes = read_line(io->file)) >= 0 ; )
+		push(line_string(bytes));
+	LIST lst = NULL;
+	for ( ; stack.top != lines ; --stack.top) lst = ___push(stack.top[-1], lst);
+	return lst;
+}
+
+static void ___forHeachHline(IO io, BLOCK f)
+{
+	// Only one line is held at a time, so files of any size can be processed in constant memory.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	for (ssize_t bytes ; (bytes = read_line(io->file)) >= 0 ; )
+	{
+		push(line_string(bytes));
+		call_block(f);
+	}
+}
+
+static char* csv_buffer = NULL; // Holds records that span several lines, and is kept between calls.
+static size_t csv_buffer_size = 0;
+
+static bool odd_quotes(const char* s, size_t bytes)
+{
+	bool odd = false;
+	for (const char* end = s + bytes ; (s = memchr(s, '"', end - s)) ; ++s) odd = !odd;
+	return odd;
+}
+
+static bool next_csv_row(IO io, char delimiter, LIST* row)
+{
+	// Reads one RFC 4180 record, which carries on past the end of a line while a quoted field is open.
+	// TSV files are read by the same rules, with tabs instead of commas.
+	// The record is copied to the heap once and unescaped in place, and its fields are views of that copy.
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	ssize_t bytes;
+	do bytes = read_line(io->file);
+	while (bytes > 0 && strspn(line_buffer, "\r\n") == (size_t)bytes); // Skip blank lines.
+	if (bytes < 0) return false;
+	const char* record = line_buffer;
+	size_t len = bytes;
+	if (odd_quotes(line_buffer, bytes))
+	{
+		bool quoted = true;
+		size_t used = 0;
+		do
+		{
+			if (used + bytes > csv_buffer_size)
+			{
+				csv_buffer_size = (used + bytes) * 2;
+				csv_buffer = realloc(csv_buffer, csv_buffer_size);
+			}
+			memcpy(csv_buffer + used, line_buffer, bytes);
+			used += bytes;
+			if (!quoted) break;
+			bytes = read_line(io->file);
+			if unlikely(bytes < 0) throw_error_fmt("Unterminated quoted field in '%s'", io->path);
+			quoted ^= odd_quotes(line_buffer, bytes);
+		} while (1);
+		record = csv_buffer;
+		len = used;
+	}
+	if (len && record[len-1] == '\n') --len;
+	if (len && record[len-1] == '\r') --len;
+	char* str = memcpy(gc_malloc_string(len), record, len);
+	char* const end = str + len;
+	ANYPTR fields = stack.top;
+	for (char* p = str ; ; ++p)
+	{
+		char* start = p;
+		char* w = p;
+		if (*p == '"')
+		{
+			// Quotes are removed and doubled quotes are halved, moving the field back over them.
+			for (++p ; p != end ; )
+			{
+				char* quote = memchr(p, '"', end - p);
+				if (!quote) quote = end;
+				memmove(w, p, quote - p);
+				w += quote - p;
+				p = quote;
+				if (p == end) break;
+				if (p + 1 != end && p[1] == '"') { *w++ = '"'; p += 2; }
+				else { ++p; break; }
+			}
+			// Anything after a closing quote is kept, as most readers do.
+			char* next = memchr(p, delimiter, end - p);
+			if (!next) next = end;
+			memmove(w, p, next - p);
+			w += next - p;
+			p = next;
+		}
+		else
+		{
+			p = memchr(p, delimiter, end - p);
+			if (!p) p = end;
+			w = p;
+		}
+		push(make_view(start, w - start, STRING_CHARS_UNKNOWN));
+		if (p == end) break;
+	}
+	LIST lst = NULL;
+	for ( ; stack.top != fields ; --stack.top) lst = ___push(stack.top[-1], lst);
+	*row = lst;
+	return true;
+}
+
+static TABLE csv_record(LIST header, LIST row)
+{
+	TABLE t = NULL;
+	for (LIST h = header, r = row ; h || r ; h = h->next, r = r->next)
+	{
+		if unlikely(!h || !r) throw_error("Row has a different number of fields to the header");
+		t = ___insert(h->object, r->object, t);
+	}
+	return t;
+}
+
+static LIST csv_rows(IO io, char delimiter)
+{
+	assert_impure();
+	ANYPTR rows = stack.top;
+	for (LIST row ; next_csv_row(io, delimiter, &row) ; ) push(box_LIST(row));
+	LIST lst = NULL;
+	for ( ; stack.top != rows ; --stack.top) lst = ___push(stack.top[-1], lst);
+	return lst;
+}
+
+static LIST csv_records(IO io, char delimiter)
+{
+	// The first row names the fields of the rest.
+	assert_impure();
+	LIST header;
+	if (!next_csv_row(io, delimiter, &header)) return NULL;
+	ANYPTR records = stack.top;
+	for (LIST row ; next_csv_row(io, delimiter, &row) ; ) push(box_TABLE(csv_record(header, row)));
+	LIST lst = NULL;
+	for ( ; stack.top != records ; --stack.top) lst = ___push(stack.top[-1], lst);
+	return lst;
+}
+
+static void for_each_csv_row(IO io, char delimiter, BLOCK f)
+{
+	// Only one row is held at a time, so files of any size can be processed in constant memory.
+	assert_impure();
+	for (LIST row ; next_csv_row(io, delimiter, &row) ; )
+	{
+		push(box_LIST(row));
+		call_block(f);
+	}
+}
+
+static void for_each_csv_record(IO io, char delimiter, BLOCK f)
+{
+	assert_impure();
+	LIST header;
+	if (!next_csv_row(io, delimiter, &header)) return;
+	for (LIST row ; next_csv_row(io, delimiter, &row) ; )
+	{
+		push(box_TABLE(csv_record(header, row)));
+		call_block(f);
+	}
+}
+
+static LIST ___csvHrows(IO io)                     { return csv_rows(io, ','); }
+static LIST ___tsvHrows(IO io)                     { return csv_rows(io, '\t'); }
+static LIST ___csvHrecords(IO io)                  { return csv_records(io, ','); }
+static LIST ___tsvHrecords(IO io)                  { return csv_records(io, '\t'); }
+static void ___forHeachHcsvHrow(IO io, BLOCK f)    { for_each_csv_row(io, ',', f); }
+static void ___forHeachHtsvHrow(IO io, BLOCK f)    { for_each_csv_row(io, '\t', f); }
+static void ___forHeachHcsvHrecord(IO io, BLOCK f) { for_each_csv_record(io, ',', f); }
+static void ___forHeachHtsvHrecord(IO io, BLOCK f) { for_each_csv_record(io, '\t', f); }
+
+typedef struct json_reader
+{
+	const char* p;
+	const char* end;
+	FILE* file;  // Read a chunk at a time into buf, or NULL when parsing a string.
+	char* buf;
+} json_reader;
+
+static char* json_scratch = NULL; // Strings are unescaped here before they're copied to the heap.
+static size_t json_scratch_size = 0;
+
+static int json_peek(json_reader* r)
+{
+	if (r->p == r->end)
+	{
+		if (!r->file) return EOF;
+		size_t n = fread(r->buf, 1, JSON_CHUNK_SIZE, r->file);
+		if (!n) return EOF;
+		r->p = r->buf;
+		r->end = r->buf + n;
+	}
+	return (unsigned char)*r->p;
+}
+
+static int json_skip(json_reader* r)
+{
+	// Skips whitespace and returns the next character without consuming it.
+	int c;
+	while ((c = json_peek(r)) == ' ' || c == '\n' || c == '\r' || c == '\t') ++r->p;
+	return c;
+}
+
+static _Noreturn void json_error(json_reader* r, const char* expected)
+{
+	int c = json_peek(r);
+	if (c == EOF) throw_error_fmt("Invalid JSON: expected %s but the input ended", expected);
+	throw_error_fmt("Invalid JSON: expected %s but got '%c'", expected, c);
+}
+
+static void json_expect(json_reader* r, char c, const char* expected)
+{
+	if unlikely(json_skip(r) != c) json_error(r, expected);
+	++r->p;
+}
+
+static void json_literal(json_reader* r, const char* word)
+{
+	for (const char* w = word ; *w ; ++w, ++r->p)
+		if unlikely(json_peek(r) != *w) json_error(r, word);
+}
+
+static void json_scratch_add(size_t used, const char* s, size_t bytes)
+{
+	if (used + bytes > json_scratch_size)
+	{
+		json_scratch_size = (used + bytes) * 2;
+		json_scratch = realloc(json_scratch, json_scratch_size);
+	}
+	memcpy(json_scratch + used, s, bytes);
+}
+
+static unsigned json_hex4(json_reader* r)
+{
+	unsigned u = 0;
+	for (int i = 0 ; i < 4 ; ++i, ++r->p)
+	{
+		int c = json_peek(r);
+		if (c >= '0' && c <= '9') u = u * 16 + c - '0';
+		else if ((c | 32) >= 'a' && (c | 32) <= 'f') u = u * 16 + (c | 32) - 'a' + 10;
+		else json_error(r, "four hex digits");
+	}
+	return u;
+}
+
+static ANY json_string(json_reader* r)
+{
+	// Runs of plain characters are copied a chunk at a time, and escapes one by one.
+	json_expect(r, '"', "a string");
+	size_t used = 0;
+	for (;;)
+	{
+		if unlikely(json_peek(r) == EOF) json_error(r, "'\"'");
+		const char* run = r->p;
+		while (r->p != r->end && *r->p != '"' && *r->p != '\\' && (unsigned char)*r->p >= 0x20) ++r->p;
+		json_scratch_add(used, run, r->p - run);
+		used += r->p - run;
+		if (r->p == r->end) continue;
+		char c = *r->p++;
+		if (c == '"') break;
+		if unlikely(c != '\\') { --r->p; json_error(r, "an escaped control character"); }
+		char out[4];
+		size_t n = 1;
+		switch (json_peek(r))
+		{
+			case '"':  out[0] = '"';  break;
+			case '\\': out[0] = '\\'; break;
+			case '/':  out[0] = '/';  break;
+			case 'b':  out[0] = '\b'; break;
+			case 'f':  out[0] = '\f'; break;
+			case 'n':  out[0] = '\n'; break;
+			case 'r':  out[0] = '\r'; break;
+			case 't':  out[0] = '\t'; break;
+			case 'u':
+				{
+					++r->p;
+					unsigned u = json_hex4(r);
+					if (u >= 0xD800 && u < 0xDC00)
+					{
+						// A surrogate pair is one character.
+						json_literal(r, "\\u");
+						unsigned lo = json_hex4(r);
+						if unlikely(lo < 0xDC00 || lo >= 0xE000) throw_error("Invalid JSON: expected a low surrogate");
+						u = 0x10000 + ((u - 0xD800) << 10) + (lo - 0xDC00);
+					}
+					else if (u >= 0xDC00 && u < 0xE000) u = 0xFFFD;
+					if (u < 0x80) out[0] = u;
+					else if (u < 0x800) { out[0] = 0xC0 | u >> 6; out[1] = 0x80 | (u & 0x3F); n = 2; }
+					else if (u < 0x10000) { out[0] = 0xE0 | u >> 12; out[1] = 0x80 | (u >> 6 & 0x3F); out[2] = 0x80 | (u & 0x3F); n = 3; }
+					else { out[0] = 0xF0 | u >> 18; out[1] = 0x80 | (u >> 12 & 0x3F); out[2] = 0x80 | (u >> 6 & 0x3F); out[3] = 0x80 | (u & 0x3F); n = 4; }
+					json_scratch_add(used, out, n);
+					used += n;
+					continue;
+				}
+			default: json_error(r, "an escape sequence");
+		}
+		++r->p;
+		json_scratch_add(used, out, n);
+		used += n;
+	}
+	if (used <= SHORT_STRING_MAX) return short_string(json_scratch, used);
+	return box_STRING(memcpy(gc_malloc_string(used), json_scratch, used));
+}
+
+static ANY json_number(json_reader* r)
+{
+	char buf[64];
+	size_t n = 0;
+	for (int c ; (c = json_peek(r)) != EOF && strchr("+-.0123456789eE", c) ; ++r->p)
+	{
+		if unlikely(n == sizeof buf - 1) json_error(r, "a shorter number");
+		buf[n++] = c;
+	}
+	buf[n] = '\0';
+	NUMBER num;
+	if (!parse_decimal(buf, buf + n, &num))
+	{
+		char* end;
+		num = strtod(buf, &end);
+		if (!n || end != buf + n) throw_error_fmt("Invalid JSON: cannot parse '%s' as a number", buf);
+	}
+	return box_NUMBER(num);
+}
+
+static void json_event(BLOCK f, SYMBOL event)
+{
+	push(box_SYMBOL(event));
+	call_block(f);
+}
+
+static ANY json_value(json_reader* r, BLOCK f, int depth)
+{
+	// Builds the value, or when there is a block, calls it for each event instead and returns nothing.
+	// Events are \object, \array and \end with nothing else on the stack, or \key and \value with the key or value beneath them.
+	if unlikely(depth > JSON_MAX_DEPTH) throw_error("Invalid JSON: nested too deeply");
+	ANY a;
+	switch (json_skip(r))
+	{
+		case '{':
+			{
+				++r->p;
+				if (f) json_event(f, SYMobject);
+				TABLE t = NULL;
+				if (json_skip(r) != '}') for (;;)
+				{
+					ANY key = json_string(r);
+					if (f) { push(key); json_event(f, SYMkey); }
+					json_expect(r, ':', "':'");
+					ANY value = json_value(r, f, depth + 1);
+					if (!f) t = ___insert(key, value, t);
+					if (json_skip(r) != ',') break;
+					++r->p;
+				}
+				json_expect(r, '}', "',' or '}'");
+				if (f) json_event(f, SYMend);
+				return box_TABLE(t);
+			}
+		case '[':
+			{
+				++r->p;
+				if (f) json_event(f, SYMarray);
+				ANYPTR items = stack.top;
+				if (json_skip(r) != ']') for (;;)
+				{
+					ANY value = json_value(r, f, depth + 1);
+					if (!f) push(value);
+					if (json_skip(r) != ',') break;
+					++r->p;
+				}
+				json_expect(r, ']', "',' or ']'");
+				if (f) { json_event(f, SYMend); return box_LIST(NULL); }
+				LIST lst = NULL;
+				for ( ; stack.top != items ; --stack.top) lst = ___push(stack.top[-1], lst);
+				return box_LIST(lst);
+			}
+		case '"': a = json_string(r); break;
+		case 't': json_literal(r, "true");  a = box_BOOLEAN(true);  break;
+		case 'f': json_literal(r, "false"); a = box_BOOLEAN(false); break;
+		case 'n': json_literal(r, "null");  a = box_SYMBOL(SYMnull); break;
+		case '-': case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+			a = json_number(r); break;
+		default: json_error(r, "a value");
+	}
+	if (f) { push(a); json_event(f, SYMvalue); }
+	return a;
+}
+
+static ANY json_document(json_reader* r, BLOCK f)
+{
+	ANY a = json_value(r, f, 0);
+	if unlikely(json_skip(r) != EOF) json_error(r, "the end of the input");
+	return a;
+}
+
+static ANY ___parseHjson(ANY str)
+{
+	if unlikely(!___stringQ(str)) type_error("string", str);
+	size_t bytes;
+	json_reader r = { .file = NULL };
+	r.p = string_span(&str, &bytes);
+	r.end = r.p + bytes;
+	return json_document(&r, NULL);
+}
+
+static ANY ___readHjson(IO io)
+{
+	// The chunk isn't on the C stack, where the GC might mistake its contents for pointers.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	char* buf = malloc(JSON_CHUNK_SIZE);
+	json_reader r = { .p = buf, .end = buf, .file = io->file, .buf = buf };
+	ANY a = json_document(&r, NULL);
+	free(buf);
+	return a;
+}
+
+static void ___forHeachHjsonHevent(IO io, BLOCK f)
+{
+	// Nothing is built, so documents of any size can be read in memory proportional to their nesting.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	char* buf = malloc(JSON_CHUNK_SIZE);
+	json_reader r = { .p = buf, .end = buf, .file = io->file, .buf = buf };
+	json_document(&r, f);
+	free(buf);
+}
+
+static void print_json_string(const char* s, size_t bytes, FILE* f)
+{
+	fputc('"', f);
+	for (const char* end = s + bytes ; s != end ; ++s)
+	{
+		unsigned char c = *s;
+		if (c == '"') fputs("\\\"", f);
+		else if (c == '\\') fputs("\\\\", f);
+		else if (c == '\n') fputs("\\n", f);
+		else if (c == '\t') fputs("\\t", f);
+		else if (c == '\r') fputs("\\r", f);
+		else if (c < 0x20) fprintf(f, "\\u%04x", c);
+		else fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void print_json(ANY a, FILE* f, int depth);
+
+static void print_json_table(TABLE t, FILE* f, int depth, bool* first)
+{
+	if (!t) return;
+	print_json_table(t->left, f, depth, first);
+	if unlikely(!___stringQ(t->key)) throw_error_fmt("Cannot write a table with %s keys as JSON", lookup_type(type_of(t->key)));
+	if (!*first) fputc(',', f);
+	*first = false;
+	print_json(t->key, f, depth);
+	fputc(':', f);
+	print_json(t->value, f, depth);
+	print_json_table(t->right, f, depth, first);
+}
+
+static bool print_json_sequence(SEQUENCE s, FILE* f, int depth, bool first)
+{
+	for (size_t i = 0 ; i < s->count ; ++i)
+	{
+		if (s->height) first = print_json_sequence(s->children[i], f, depth, first);
+		else
+		{
+			if (!first) fputc(',', f);
+			print_json(s->items[i], f, depth);
+			first = false;
+		}
+	}
+	return first;
+}
+
+static void print_json(ANY a, FILE* f, int depth)
+{
+	// Like print_object, but in JSON. Values that JSON has no way to write are errors.
+	if unlikely(++depth > JSON_MAX_DEPTH) throw_error("Cannot write a value nested this deeply as JSON");
+	char buf[32];
+	switch (type_of(a))
+	{
+		case NUMBER_TYPE:
+			if unlikely(!isfinite(unbox_NUMBER(a))) throw_error_fmt("Cannot write %g as JSON", unbox_NUMBER(a));
+			// Show rounds to 14 digits, but JSON is for other programs, so use the fewest digits that read back the same.
+			for (int digits = 15 ; digits <= 17 ; ++digits)
+			{
+				sprintf(buf, "%.*g", digits, unbox_NUMBER(a));
+				if (strtod(buf, NULL) == unbox_NUMBER(a)) break;
+			}
+			fputs(buf, f);
+			break;
+		case BOOLEAN_TYPE: fputs(unbox_BOOLEAN(a) ? "true" : "false", f); break;
+		case STRING_TYPE:
+			{
+				size_t bytes;
+				STRING s = string_span(&a, &bytes);
+				print_json_string(s, bytes, f);
+				break;
+			}
+		case SYMBOL_TYPE:
+			{
+				SYMBOL s = unbox_SYMBOL(a);
+				if (s == SYMnull) fputs("null", f);
+				else print_json_string(s, strlen(s), f);
+				break;
+			}
+		case LIST_TYPE:
+			fputc('[', f);
+			for (LIST l = unbox_LIST(a) ; l ; l = l->next)
+			{
+				print_json(l->object, f, depth);
+				if (l->next) fputc(',', f);
+			}
+			fputc(']', f);
+			break;
+		case TABLE_TYPE:
+			{
+				bool first = true;
+				fputc('{', f);
+				print_json_table(unbox_TABLE(a), f, depth, &first);
+				fputc('}', f);
+				break;
+			}
+		case ARRAY_TYPE:
+			{
+				ARRAY arr = unbox_ARRAY(a);
+				fputc('[', f);
+				for (size_t i = 0 ; i < arr->length ; ++i)
+				{
+					if (i) fputc(',', f);
+					print_json(box_NUMBER(arr->items[i]), f, depth);
+				}
+				fputc(']', f);
+				break;
+			}
+		case VECTOR_TYPE:
+			{
+				VECTOR v = unbox_VECTOR(a);
+				fputc('[', f);
+				for (size_t i = 0 ; i < v->length ; ++i)
+				{
+					if (i) fputc(',', f);
+					print_json(v->items[i], f, depth);
+				}
+				fputc(']', f);
+				break;
+			}
+		case SEQUENCE_TYPE:
+			fputc('[', f);
+			if (a & PTR_MASK) print_json_sequence((SEQUENCE)(a & PTR_MASK), f, depth, true);
+			fputc(']', f);
+			break;
+		default: throw_error_fmt("Cannot write a %s as JSON", lookup_type(type_of(a)));
+	}
+}
+
+static STRING ___json(ANY a)
+{
+	char* buf;
+	size_t bytes;
+	FILE* f = open_memstream(&buf, &bytes);
+	print_json(a, f, 0);
+	fclose(f);
+	char* str = memcpy(gc_malloc_string(bytes), buf, bytes);
+	free(buf);
+	return str;
+}
+
+static void ___writeHjson(ANY a, IO io)
+{
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	print_json(a, io->file, 0);
+}
+
+static IO ___standardHinput(void)
+{
+	assert_impure();
+	IO io = gc_malloc(sizeof *io);
+	io->path = "/dev/stdin";
+	io->mode = "r";
+	io->file = stdin;
+	io->buffer = NULL;
+	return io;
+}
+
+static void ___close(IO io)
+{
+	assert_impure();
+	fclose(io->file);
 	io->file = NULL;
+	free(io->buffer);
+	io->buffer = NULL;
 }
 
 static BOOLEAN ___openQ(IO io)
@@ -2343,40 +4172,302 @@ static STRING ___fileHmode(IO io)
 
 static void ___write(STRING s, IO io)
 {
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
 	fputs(s, io->file);
 }
 
-static void ___seek(SYMBOL ref, NUMBER n, IO io)
+static void write_batch(IO io, struct iovec* iov, int n)
 {
-	int pos;
-	if (ref == SYMstart) pos = SEEK_SET;
-	else if (ref == SYMend) pos = SEEK_END;
-	else if (ref == SYMcurrent) pos = SEEK_CUR;
-	else throw_error_fmt("Expected one of \\start, \\end, \\current");
-	long offset = n;
-	if unlikely(offset != n || fseek(io->file, offset, pos))
-		throw_error_fmt("Can't seek to position %.14g relative to %s", n, ref);
+	while (n)
+	{
+		const ssize_t written = writev(fileno(io->file), iov, n);
+		if unlikely(written < 0)
+		{
+			if (errno == EINTR) continue;
+			throw_error_fmt("Cannot write to file '%s'", io->path);
+		}
+		size_t left = written;
+		for ( ; n && left >= iov->iov_len ; ++iov, --n) left -= iov->iov_len;
+		if (n)
+		{
+			iov->iov_base = (char*)iov->iov_base + left;
+			iov->iov_len -= left;
+		}
+	}
 }
 
-static void invalid_jump(ANY* env)
+static void ___writeHall(LIST l, IO io)
 {
-	throw_error("Cannot resume expired continuation");
+	// Writes a list of strings with one writev per batch, instead of a builtin call and a copy into the stream per string.
+	// Small strings are gathered into a staging buffer, but large ones go to the file without being copied.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	for (LIST c = l ; c ; c = c->next)
+		if unlikely(!___stringQ(c->object)) type_error("string", c->object);
+	static char* staging = NULL;
+	if (!staging) staging = malloc(WRITE_BUFFER_SIZE);
+	struct iovec iov[IOV_MAX];
+	int n = 0;
+	size_t staged = 0;
+	fflush(io->file);
+	for ( ; l ; l = l->next)
+	{
+		size_t bytes;
+		STRING str = string_span(&l->object, &bytes);
+		if (!bytes) continue;
+		const bool small = bytes < WRITE_PIECE_SIZE;
+		if ((small && staged + bytes > WRITE_BUFFER_SIZE) || n == IOV_MAX)
+		{
+			write_batch(io, iov, n);
+			n = 0;
+			staged = 0;
+		}
+		if (!small) iov[n++] = (struct iovec){ .iov_base = (void*)str, .iov_len = bytes };
+		else
+		{
+			// Consecutive small strings share an iovec.
+			if (n && (char*)iov[n - 1].iov_base + iov[n - 1].iov_len == staging + staged) iov[n - 1].iov_len += bytes;
+			else iov[n++] = (struct iovec){ .iov_base = staging + staged, .iov_len = bytes };
+			memcpy(staging + staged, str, bytes);
+			staged += bytes;
+		}
+	}
+	write_batch(io, iov, n);
 }
 
-static void oh_no(ANY* env)
+static BYTES ___readHbytes(NUMBER n, IO io)
 {
-#ifdef DEBUG
-	// Remove all the now-invalid backtraces.
-	while ((char*)trace < *(char**)(1 + (jmp_buf*)env)) trace = trace->next;
-#endif
-	longjmp(*(jmp_buf*)env, 1);
+	// Reads up to n bytes from where the file is, so fewer come back at its end, and none after it.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	size_t bytes = n;
+	if unlikely(n < 0 || bytes != n) throw_error_fmt("Can't read %.14g bytes", n);
+	cognate_bytes* b = bytes_alloc(bytes);
+	if (!bytes) return b;
+	b->length = fread(b->data, 1, bytes, io->file);
+	if unlikely(ferror(io->file)) throw_error_fmt("Error reading file '%s'", io->path);
+	if (!b->length) b->data = NULL;
+	return b;
 }
 
-__attribute__((returns_twice))
-static void ___begin(BLOCK f)
+static BYTES ___readHfileHbytes(IO io)
 {
-#ifdef DEBUG
-	BLOCK a = gc_malloc(sizeof *a + sizeof(jmp_buf) + sizeof(char*));
+	assert_impure();
+	FILE *fp = io->file;
+	if unlikely(!fp) throw_error_fmt("File '%s' is not open", io->path);
+	fseek(fp, 0, SEEK_SET);
+	struct stat st;
+	fstat(fileno(fp), &st);
+	cognate_bytes* b = bytes_alloc(st.st_size);
+	if (st.st_size && fread(b->data, 1, st.st_size, fp) != (size_t)st.st_size)
+		throw_error_fmt("Error reading file '%s'", io->path);
+	return b;
+}
+
+static void ___writeHbytes(BYTES b, IO io)
+{
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	if (b->length && fwrite(b->data, 1, b->length, io->file) != b->length)
+		throw_error_fmt("Error writing file '%s'", io->path);
+}
+
+typedef struct table_file_header
+{
+	char magic[8];
+	uint64_t base; // The address the file was laid out for.
+	ANY root;
+	uint64_t size;
+} table_file_header;
+
+typedef struct table_writer
+{
+	FILE* file;
+	uint64_t base;
+	uint64_t offset;
+} table_writer;
+
+static void table_file_write(table_writer* w, const void* data, size_t bytes)
+{
+	if unlikely(fwrite(data, 1, bytes, w->file) != bytes) throw_error("Error writing table file");
+	w->offset += bytes;
+}
+
+static uint64_t table_file_put(table_writer* w, const void* data, size_t bytes)
+{
+	// Everything is padded to 8 bytes, so tables and lists are aligned wherever the file is mapped.
+	static const char padding[8] = {0};
+	const uint64_t address = w->base + w->offset;
+	table_file_write(w, data, bytes);
+	table_file_write(w, padding, -w->offset & 7);
+	return address;
+}
+
+static ANY table_file_object(table_writer* w, ANY a)
+{
+	// Objects are written after everything they point to, so every address is known when it's written.
+	// Values are laid out exactly as in the heap, with pointers to where they'll be once the file is mapped at its base.
+	switch (type_of(a))
+	{
+		case NUMBER_TYPE: case BOOLEAN_TYPE: return a;
+		case STRING_TYPE:
+			{
+				if ((a & SHORT_STRING_TYPE) == SHORT_STRING_TYPE) return a; // Held in the value itself.
+				size_t bytes;
+				STRING str = string_span(&a, &bytes);
+				const uint64_t address = w->base + w->offset;
+				table_file_write(w, str, bytes);
+				table_file_put(w, "", 1);
+				return STRING_TYPE | address;
+			}
+		case LIST_TYPE:
+			{
+				// Items go on the stack, so the cells can be written from the end without recursing down the list.
+				ANYPTR items = stack.top;
+				for (LIST l = unbox_LIST(a) ; l ; l = l->next) push(table_file_object(w, l->object));
+				uint64_t next = 0;
+				for ( ; stack.top != items ; --stack.top)
+				{
+					cognate_list cell = { .next = (LIST)next, .object = stack.top[-1] };
+					next = table_file_put(w, &cell, sizeof cell);
+				}
+				return LIST_TYPE | next;
+			}
+		case TABLE_TYPE:
+			{
+				TABLE t = unbox_TABLE(a);
+				if (!t) return a;
+				cognate_table node = { .level = t->level };
+				node.left = (TABLE)(table_file_object(w, box_TABLE(t->left)) & PTR_MASK);
+				node.right = (TABLE)(table_file_object(w, box_TABLE(t->right)) & PTR_MASK);
+				node.key = table_file_object(w, t->key);
+				node.value = table_file_object(w, t->value);
+				return TABLE_TYPE | table_file_put(w, &node, sizeof node);
+			}
+		default: throw_error_fmt("Can't write %s to a table file", ___show(a));
+	}
+	#ifdef __TINYC__
+	return NIL;
+	#endif
+}
+
+static void ___writeHtable(TABLE t, IO io)
+{
+	// Each path gets its own slot of address space, so several table files can usually all be mapped at their bases.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	if unlikely(ftell(io->file) != 0) throw_error_fmt("A table must be written at the start of '%s'", io->path);
+	const uint64_t slot = hash_string(io->path, strlen(io->path)) % TABLE_FILE_SLOTS;
+	table_writer w = { .file = io->file, .base = TABLE_FILE_BASE + slot * TABLE_FILE_SLOT };
+	table_file_header h = { .magic = TABLE_FILE_MAGIC, .base = w.base };
+	table_file_write(&w, &h, sizeof h); // Filled in once the root's address is known.
+	h.root = table_file_object(&w, box_TABLE(t));
+	h.size = w.offset;
+	if unlikely(fseek(io->file, 0, SEEK_SET) || fwrite(&h, sizeof h, 1, io->file) != 1 || fseek(io->file, 0, SEEK_END))
+		throw_error_fmt("Error writing table file '%s'", io->path);
+}
+
+static ANY table_file_relocate(ANY a, uint64_t delta)
+{
+	// Only needed when something else is at the file's base. Nothing in the file is shared, so each object is moved once.
+	// Pointers are moved by adding to the whole value, which wraps around to subtract when delta is negative.
+	switch (type_of(a))
+	{
+		case STRING_TYPE: return flat_string(a) ? a + delta : a;
+		case LIST_TYPE:
+			if (!(a & PTR_MASK)) return a;
+			a += delta;
+			for (cognate_list* l = (cognate_list*)(a & PTR_MASK) ; l ; l = (cognate_list*)l->next)
+			{
+				l->object = table_file_relocate(l->object, delta);
+				if (l->next) l->next = (LIST)((uint64_t)l->next + delta);
+			}
+			return a;
+		case TABLE_TYPE:
+			{
+				if (!(a & PTR_MASK)) return a;
+				a += delta;
+				cognate_table* t = (cognate_table*)(a & PTR_MASK);
+				t->key = table_file_relocate(t->key, delta);
+				t->value = table_file_relocate(t->value, delta);
+				t->left = (TABLE)(table_file_relocate(box_TABLE(t->left), delta) & PTR_MASK);
+				t->right = (TABLE)(table_file_relocate(box_TABLE(t->right), delta) & PTR_MASK);
+				return a;
+			}
+		default: return a;
+	}
+}
+
+static TABLE ___readHtable(IO io)
+{
+	// The file is read into its own mapping, at the address it was written for if possible, and used there without being parsed.
+	// Mapping the file itself would only read the pages that lookups touch, but then rewriting the file would change (or fault) the table.
+	// The mapping is writable, as Remove adjusts the levels of nodes it shares with the original table.
+	// Nothing outside the heap is traced, so the mapping is kept until the program exits.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	const int fd = fileno(io->file);
+	struct stat st;
+	table_file_header h;
+	if unlikely(fstat(fd, &st) || (size_t)st.st_size < sizeof h || pread(fd, &h, sizeof h, 0) != sizeof h
+			|| memcmp(h.magic, TABLE_FILE_MAGIC, sizeof h.magic) || h.size != (uint64_t)st.st_size)
+		throw_error_fmt("'%s' is not a table file", io->path);
+	char* data = mmap((void*)h.base, h.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if unlikely(data == MAP_FAILED) throw_error_fmt("Cannot map table file '%s'", io->path);
+	for (size_t done = 0 ; done < h.size ; )
+	{
+		ssize_t n = pread(fd, data + done, h.size - done, done);
+		if unlikely(n <= 0)
+		{
+			munmap(data, h.size);
+			throw_error_fmt("Error reading file '%s'", io->path);
+		}
+		done += n;
+	}
+	if ((uint64_t)data != h.base) h.root = table_file_relocate(h.root, (uint64_t)data - h.base);
+	return unbox_TABLE(h.root);
+}
+
+static void ___writeHvalue(ANY a, IO io)
+{
+	// Writes a value to a file the way Put writes it to standard output, without rendering it in memory first.
+	assert_impure();
+	if unlikely(!io->file) throw_error_fmt("File '%s' is not open", io->path);
+	put_object(a, io->file);
+}
+
+static void ___seek(SYMBOL ref, NUMBER n, IO io)
+{
+	int pos;
+	if (ref == SYMstart) pos = SEEK_SET;
+	else if (ref == SYMend) pos = SEEK_END;
+	else if (ref == SYMcurrent) pos = SEEK_CUR;
+	else throw_error_fmt("Expected one of \\start, \\end, \\current");
+	long offset = n;
+	if unlikely(offset != n || fseek(io->file, offset, pos))
+		throw_error_fmt("Can't seek to position %.14g relative to %s", n, ref);
+}
+
+static void invalid_jump(ANY* env)
+{
+	throw_error("Cannot resume expired continuation");
+}
+
+static void oh_no(ANY* env)
+{
+#ifdef DEBUG
+	// Remove all the now-invalid backtraces.
+	while ((char*)trace < *(char**)(1 + (jmp_buf*)env)) trace = trace->next;
+#endif
+	longjmp(*(jmp_buf*)env, 1);
+}
+
+__attribute__((returns_twice))
+static void ___begin(BLOCK f)
+{
+#ifdef DEBUG
+	BLOCK a = gc_malloc(sizeof *a + sizeof(jmp_buf) + sizeof(char*));
 	// Add the address of the stack pointer so we know which backtraces to pop.
 	char c;
 	*(char**)(1 + (jmp_buf*)&a->env) = &c;
@@ -2394,332 +4485,2447 @@ static void ___begin(BLOCK f)
 	}
 }
 
-static LIST ___empty (void)
+static LIST ___empty (void)
+{
+	return NULL;
+}
+
+static TABLE ___table (BLOCK expr)
+{
+	ANYPTR tmp_stack_start = stack.start;
+	stack.start = stack.top;
+	// Eval expr
+	call_block(expr);
+	// Move to a table.
+	TABLE d = NULL;
+	size_t len = stack_length();
+	if unlikely(len & 1) throw_error("Table initialiser must be key-value pairs");
+	for (size_t i = 0; i < len; i += 2)
+	{
+		ANY key = stack.start[i+1];
+		ANY value = stack.start[i];
+		d = ___insert(key, value, d);
+	}
+	stack.top = stack.start;
+	stack.start = tmp_stack_start;
+	return d;
+}
+
+static TABLE mktable(ANY key, ANY value, TABLE left, TABLE right, size_t level)
+{
+	TABLE t = gc_malloc(sizeof *t);
+	t->key = key;
+	t->value = value;
+	t->left = left;
+	t->right = right;
+	t->level = level;
+	gc_mark_ptr((void*)&t->left);
+	gc_mark_ptr((void*)&t->right);
+	gc_mark_any(&t->key);
+	gc_mark_any(&t->value);
+	return t;
+}
+
+static TABLE ___insert(ANY key, ANY value, TABLE d)
+{
+	cognate_type t = TYPE_MASK & key;
+	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE || t == VECTOR_TYPE || t == BUILDER_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
+	if (!d) return mktable(key, value, NULL, NULL, 1);
+	ptrdiff_t diff = compare_objects(d->key, key);
+	if (diff == 0) return mktable(key, value, d->left, d->right, d->level);
+	if (diff > 0)
+		return
+			table_split(table_skew(
+				mktable(d->key, d->value, ___insert(key, value, d->left), d->right, d->level)));
+	else //if (diff < 0)
+		return
+			table_split(table_skew(
+				mktable(d->key, d->value, d->left, ___insert(key, value, d->right), d->level)));
+}
+
+static ANY ___D(ANY key, TABLE d)
+{
+	cognate_type t = TYPE_MASK & key;
+	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE || t == VECTOR_TYPE || t == BUILDER_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
+	while (d)
+	{
+		ptrdiff_t diff = compare_objects(d->key, key);
+		if (diff == 0) return d->value;
+		else if (diff > 0) d = d->left;
+		else d = d->right;
+	}
+
+	throw_error_fmt("%s is not in table", ___show(key));
+	#ifdef __TINYC__
+	return NIL;
+	#endif
+}
+
+static BOOLEAN ___has(ANY key, TABLE d)
+{
+	cognate_type t = TYPE_MASK & key;
+	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE || t == VECTOR_TYPE || t == BUILDER_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
+	while (d)
+	{
+		ptrdiff_t diff = compare_objects(d->key, key);
+		if (diff == 0) return true;
+		else if (diff > 0) d = d->left;
+		else d = d->right;
+	}
+
+	return false;
+}
+
+static TABLE ___remove(ANY key, TABLE T)
+{
+	// input: X, the key to delete, and T, the root of the tree from which it should be deleted.
+   // output: T, balanced, without the value X.
+	cognate_type t = TYPE_MASK & key;
+	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE || t == VECTOR_TYPE || t == BUILDER_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
+	if (!T) throw_error_fmt("Key %s not in table", ___show(key));
+	ptrdiff_t diff = compare_objects(T->key, key);
+	TABLE T2 = NULL;
+	// This part is fairly intuitive - if this breaks it's probably not here:
+	if (diff < 0)
+		T2 = mktable(T->key, T->value, T->left, ___remove(key, T->right), T->level);
+	else if (diff > 0)
+		T2 = mktable(T->key, T->value, ___remove(key, T->left), T->right, T->level);
+	else if (!T->left && !T->right) return NULL;
+	else if (!T->left) // T->right not null
+	{
+		TABLE L = T->right;
+		while (L->left) L = L->left; // successor
+		T2 = mktable(L->key, L->value, T->left, ___remove(L->key, T->right), L->level);
+	}
+	else // left and right not null
+	{
+		TABLE L = T->left;
+		while (L->right) L = L->right; // predecessor
+		T2 = mktable(L->key, L->value, ___remove(L->key, T->left), T->right, L->level);
+	}
+
+	// below here idk really what's going on, but it seems to work:
+
+	if (T2->left && T2->right)
+	{
+		long llevel = T2->left->level;
+		long rlevel = T2->right->level;
+		long should_be = 1 + (llevel < rlevel ? llevel : rlevel);
+
+		if (should_be < T2->level)
+		{
+			T2->level = should_be;
+			if (should_be < T2->right->level)
+				T2->right->level = should_be;
+		}
+	}
+
+	// This part makes at least vague sense:
+
+	/* Commented these bits out because the GC can't handle them
+	 * Probably worth implementing a recursive skew and split at some point.
+	 * IDK how balanced the table is gonna be after this
+	if (T2->right)
+	{
+		T2->right->right = table_skew(T2->right->right);
+		T2->right = table_skew(T2->right);
+	}
+	*/
+	T2 = table_skew(T2);
+	//if (T2->right) T2->right = table_split(T2->right);
+	T2 = table_split(T2);
+
+	return T2;
+}
+
+static LIST values_helper(TABLE T, LIST L)
+{
+	if (!T) return L;
+	return values_helper(T->left, ___push(T->value, values_helper(T->right, L)));
+}
+
+static LIST ___values(TABLE T)
+{
+	return values_helper(T, NULL);
+}
+
+static LIST keys_helper(TABLE T, LIST L)
+{
+	if (!T) return L;
+	return keys_helper(T->left, ___push(T->key, keys_helper(T->right, L)));
+}
+
+static LIST ___keys(TABLE T)
+{
+	return keys_helper(T, NULL);
+}
+
+static void table_flatten(TABLE T)
+{
+	// Pushes the entries of T onto the stack as key-value pairs in ascending key order. O(n).
+	for ( ; T ; T = T->right)
+	{
+		table_flatten(T->left);
+		push(T->key);
+		push(T->value);
+	}
+}
+
+static TABLE table_from_sorted(const ANY* entries, size_t n)
+{
+	// Builds a perfectly balanced AA tree from n ascending key-value pairs. O(n).
+	// Giving each node level floor(log2(size + 1)) satisfies the AA invariants,
+	// since the right subtree is never smaller than the left one.
+	if (!n) return NULL;
+	const size_t mid = (n - 1) / 2;
+	size_t level = 0;
+	for (size_t s = n + 1 ; s > 1 ; s >>= 1) level++;
+	TABLE left = table_from_sorted(entries, mid);
+	TABLE right = table_from_sorted(entries + 2 * (mid + 1), n - mid - 1);
+	return mktable(entries[2 * mid], entries[2 * mid + 1], left, right, level);
+}
+
+#define TABLE_UNION        0
+#define TABLE_INTERSECTION 1
+#define TABLE_DIFFERENCE   2
+#define TABLE_MERGE        3
+
+static TABLE table_combine(int op, BLOCK f, TABLE t1, TABLE t2)
+{
+	// Combines two tables in a single ordered traversal. O(n + m).
+	// The stack is used as scratch space so that the GC can see (and move) everything.
+	ANYPTR base = stack.top;
+	table_flatten(t1);
+	ANYPTR a = base;
+	ANYPTR a_end = stack.top;
+	table_flatten(t2);
+	ANYPTR b = a_end;
+	ANYPTR b_end = stack.top;
+	ANYPTR out = stack.top;
+	while (a != a_end || b != b_end)
+	{
+		ptrdiff_t diff = a == a_end ? 1 : b == b_end ? -1 : compare_objects(a[0], b[0]);
+		if (diff < 0)
+		{
+			if (op == TABLE_UNION || op == TABLE_MERGE) { push(a[0]); push(a[1]); }
+			a += 2;
+		}
+		else if (diff > 0)
+		{
+			if (op != TABLE_INTERSECTION) { push(b[0]); push(b[1]); }
+			b += 2;
+		}
+		else if (op == TABLE_MERGE)
+		{
+			push(a[0]);
+			ANYPTR tmp_stack_start = stack.start;
+			stack.start = stack.top;
+			push(b[1]);
+			push(a[1]);
+			call_block(f);
+			if unlikely(stack_length() != 1) throw_error("Merge block must return exactly one value");
+			ANY v = pop();
+			stack.start = tmp_stack_start;
+			push(v);
+			a += 2, b += 2;
+		}
+		else
+		{
+			if (op != TABLE_DIFFERENCE) { push(a[0]); push(a[1]); }
+			a += 2, b += 2;
+		}
+	}
+	TABLE t = table_from_sorted(out, (stack.top - out) / 2);
+	stack.top = base;
+	return t;
+}
+
+static TABLE ___union(TABLE t1, TABLE t2)
+{
+	// Entries of both tables. Where a key is in both, the value from t1 is kept.
+	return table_combine(TABLE_UNION, NULL, t1, t2);
+}
+
+static TABLE ___intersection(TABLE t1, TABLE t2)
+{
+	// Entries of t1 whose keys are also in t2.
+	return table_combine(TABLE_INTERSECTION, NULL, t1, t2);
+}
+
+static TABLE ___difference(TABLE t1, TABLE t2)
+{
+	// Entries of t2 whose keys are not in t1 - so Difference A from B reads like - A B.
+	return table_combine(TABLE_DIFFERENCE, NULL, t1, t2);
+}
+
+static TABLE ___merge(BLOCK f, TABLE t1, TABLE t2)
+{
+	// Like Union, but values of keys in both tables are combined with f,
+	// which gets the value from t1 on top of the value from t2.
+	return table_combine(TABLE_MERGE, f, t1, t2);
+}
+
+static NUMBER ___length_TABLE(TABLE T)
+{
+	if (!T) return 0;
+	return 1 + ___length_TABLE(T->left) + ___length_TABLE(T->right);
+}
+
+static NUMBER ___length_LIST(LIST l)
+{
+	size_t len = 0;
+	while (l)
+	{
+		len++;
+		l = l->next;
+	}
+	return (NUMBER)len;
+}
+
+static NUMBER ___length_STRING(STRING str)
+{
+	// O(1) after the first time for strings with a header.
+	return string_chars(str);
+}
+
+#ifndef __TINYC__
+// The C compiler won't reassociate floating point reductions, so it can't vectorise them by itself.
+// Instead they keep a vector of partial results, which GCC and Clang lower to whatever SIMD the target has.
+typedef NUMBER array_lanes __attribute__((vector_size(32), aligned(sizeof(NUMBER))));
+typedef int64_t array_mask __attribute__((vector_size(32), aligned(sizeof(NUMBER))));
+#define ARRAY_LANES (sizeof(array_lanes) / sizeof(NUMBER))
+
+static void array_load(array_lanes* v, const NUMBER* x)
+{
+	// Loads through a pointer, since returning a vector by value changes the ABI without AVX.
+	memcpy(v, x, sizeof *v);
+}
+#endif
+
+static cognate_array* array_alloc(size_t length)
+{
+	cognate_array* a = gc_malloc(sizeof(cognate_array) + length * sizeof(NUMBER));
+	a->length = length;
+	return a;
+}
+
+static NUMBER array_sum(const NUMBER* x, size_t n)
+{
+	NUMBER sum = 0;
+	size_t i = 0;
+#ifndef __TINYC__
+	array_lanes acc = {0}, v;
+	for ( ; i + ARRAY_LANES <= n ; i += ARRAY_LANES)
+	{
+		array_load(&v, x + i);
+		acc += v;
+	}
+	for (size_t j = 0 ; j < ARRAY_LANES ; ++j) sum += acc[j];
+#endif
+	for ( ; i < n ; ++i) sum += x[i];
+	return sum;
+}
+
+static NUMBER array_product(const NUMBER* x, size_t n)
+{
+	NUMBER product = 1;
+	size_t i = 0;
+#ifndef __TINYC__
+	array_lanes acc = (array_lanes){0} + 1, v;
+	for ( ; i + ARRAY_LANES <= n ; i += ARRAY_LANES)
+	{
+		array_load(&v, x + i);
+		acc *= v;
+	}
+	for (size_t j = 0 ; j < ARRAY_LANES ; ++j) product *= acc[j];
+#endif
+	for ( ; i < n ; ++i) product *= x[i];
+	return product;
+}
+
+static NUMBER array_dot(const NUMBER* x, const NUMBER* y, size_t n)
+{
+	NUMBER sum = 0;
+	size_t i = 0;
+#ifndef __TINYC__
+	array_lanes acc = {0}, v, w;
+	for ( ; i + ARRAY_LANES <= n ; i += ARRAY_LANES)
+	{
+		array_load(&v, x + i);
+		array_load(&w, y + i);
+		acc += v * w;
+	}
+	for (size_t j = 0 ; j < ARRAY_LANES ; ++j) sum += acc[j];
+#endif
+	for ( ; i < n ; ++i) sum += x[i] * y[i];
+	return sum;
+}
+
+static NUMBER array_extreme(const NUMBER* x, size_t n, bool greatest)
+{
+	// Expects n > 0.
+	NUMBER m = x[0];
+	size_t i = 0;
+#ifndef __TINYC__
+	if (n >= ARRAY_LANES)
+	{
+		array_lanes acc, v;
+		array_load(&acc, x);
+		for (i = ARRAY_LANES ; i + ARRAY_LANES <= n ; i += ARRAY_LANES)
+		{
+			array_load(&v, x + i);
+			array_mask take = greatest ? v > acc : v < acc;
+			acc = (array_lanes)(((array_mask)v & take) | ((array_mask)acc & ~take));
+		}
+		for (size_t j = 0 ; j < ARRAY_LANES ; ++j)
+			if (greatest ? acc[j] > m : acc[j] < m) m = acc[j];
+	}
+#endif
+	for ( ; i < n ; ++i)
+		if (greatest ? x[i] > m : x[i] < m) m = x[i];
+	return m;
+}
+
+static void array_check_lengths(ARRAY a1, ARRAY a2)
+{
+	if unlikely(a1->length != a2->length)
+		throw_error_fmt("Arrays have different lengths (%zu and %zu)", a1->length, a2->length);
+}
+
+static ARRAY ___array(BLOCK expr)
+{
+	ANYPTR tmp_stack_start = stack.start;
+	stack.start = stack.top;
+	call_block(expr);
+	size_t len = stack_length();
+	cognate_array* a = array_alloc(len);
+	// The first item is on top of the stack, like in List.
+	for (size_t i = 0 ; i < len ; ++i)
+		a->items[i] = unbox_NUMBER(stack.top[-1 - (ptrdiff_t)i]);
+	stack.top = stack.start;
+	stack.start = tmp_stack_start;
+	return a;
+}
+
+static ARRAY ___arrayHfrom(LIST l)
+{
+	cognate_array* a = array_alloc(___length_LIST(l));
+	for (size_t i = 0 ; l ; l = l->next, ++i)
+		a->items[i] = unbox_NUMBER(l->object);
+	return a;
+}
+
+static ARRAY ___numbers(STRING sep, ANY a)
+{
+	// Parses each field in place, so there are no strings for the pieces and no list in between.
+	// Fields are separated like Split, and may have whitespace around them.
+	if unlikely(!___stringQ(a)) type_error("string", a);
+	const size_t sep_bytes = string_bytes(sep);
+	if unlikely(!sep_bytes) throw_error("Separator cannot be empty");
+	size_t bytes;
+	STRING str = string_span(&a, &bytes);
+	STRING end = str + bytes;
+	ANYPTR fields = stack.top;
+	while (str != end)
+	{
+		STRING found = find_bytes(str, end - str, sep, sep_bytes);
+		STRING field_end = found ? found : end;
+		STRING lo = str, hi = field_end;
+		while (lo != hi && isspace((unsigned char)*lo)) ++lo;
+		while (hi != lo && isspace((unsigned char)hi[-1])) --hi;
+		if (lo != hi)
+		{
+			NUMBER n;
+			if (!parse_decimal(lo, hi, &n))
+			{
+				char buf[64];
+				char* num_end;
+				if (hi - lo >= (ptrdiff_t)sizeof buf) throw_error_fmt("Cannot parse '%.*s' to a number", 32, lo);
+				memcpy(buf, lo, hi - lo);
+				buf[hi - lo] = '\0';
+				n = strtod(buf, &num_end);
+				if (num_end != buf + (hi - lo)) throw_error_fmt("Cannot parse '%s' to a number", buf);
+				if (isnan(n)) n = NAN; // As in Number.
+			}
+			push(box_NUMBER(n));
+		}
+		if (!found) break;
+		str = found + sep_bytes;
+	}
+	cognate_array* arr = array_alloc(stack.top - fields);
+	for (size_t i = 0 ; i < arr->length ; ++i) arr->items[i] = unbox_NUMBER(fields[i]);
+	stack.top = fields;
+	return arr;
+}
+
+static LIST ___elements_ARRAY(ARRAY a)
+{
+	LIST l = NULL;
+	for (size_t i = a->length ; i-- ; )
+		l = ___push(box_NUMBER(a->items[i]), l);
+	return l;
+}
+
+static NUMBER ___element(NUMBER n, ARRAY a)
+{
+	if unlikely(n < 0 || n != (size_t)n || (size_t)n >= a->length)
+		throw_error_fmt("Index %.14g is out of range for an array of length %zu", n, a->length);
+	return a->items[(size_t)n];
+}
+
+static NUMBER ___length_ARRAY(ARRAY a)
+{
+	return a->length;
+}
+
+static NUMBER ___sum(ARRAY a)
+{
+	return array_sum(a->items, a->length);
+}
+
+static NUMBER ___product(ARRAY a)
+{
+	return array_product(a->items, a->length);
+}
+
+static NUMBER ___minimum(ARRAY a)
+{
+	if unlikely(!a->length) throw_error("Empty array has no minimum");
+	return array_extreme(a->items, a->length, false);
+}
+
+static NUMBER ___maximum(ARRAY a)
+{
+	if unlikely(!a->length) throw_error("Empty array has no maximum");
+	return array_extreme(a->items, a->length, true);
+}
+
+static NUMBER ___dot(ARRAY a1, ARRAY a2)
+{
+	array_check_lengths(a1, a2);
+	return array_dot(a1->items, a2->items, a1->length);
+}
+
+// Elementwise loops vectorise without help, so they only need to be told the result doesn't alias.
+
+static ARRAY ___addHarrays(ARRAY a1, ARRAY a2)
+{
+	array_check_lengths(a1, a2);
+	cognate_array* a = array_alloc(a1->length);
+	NUMBER* restrict out = a->items;
+	for (size_t i = 0 ; i < a->length ; ++i) out[i] = a1->items[i] + a2->items[i];
+	return a;
+}
+
+static ARRAY ___multiplyHarrays(ARRAY a1, ARRAY a2)
+{
+	array_check_lengths(a1, a2);
+	cognate_array* a = array_alloc(a1->length);
+	NUMBER* restrict out = a->items;
+	for (size_t i = 0 ; i < a->length ; ++i) out[i] = a1->items[i] * a2->items[i];
+	return a;
+}
+
+static ARRAY ___scale(NUMBER n, ARRAY a1)
+{
+	cognate_array* a = array_alloc(a1->length);
+	NUMBER* restrict out = a->items;
+	for (size_t i = 0 ; i < a->length ; ++i) out[i] = n * a1->items[i];
+	return a;
+}
+
+/*
+ * Sequences are relaxed radix balanced trees. All leaves are at the same depth, and each
+ * branch keeps the cumulative lengths of its children, so nodes needn't be full.
+ * Dense trees are indexed by radix, and the size tables correct for any sparse nodes.
+ * Every node is immutable, and updates copy only the path to the leaf they change.
+ */
+
+static SEQUENCE seq_node(size_t height, size_t count, const void* slots)
+{
+	// The slots must be older than the new node, since the GC has no write barrier.
+	cognate_sequence* s = gc_malloc(sizeof *s + (height ? 2 : 1) * count * sizeof(ANY));
+	s->height = height;
+	s->count = count;
+	if (!height)
+	{
+		memcpy(s->items, slots, count * sizeof(ANY));
+		for (size_t i = 0 ; i < count ; ++i) gc_mark_any(&s->items[i]);
+		s->length = count;
+	}
+	else
+	{
+		size_t* sizes = (size_t*)&s->children[count];
+		size_t length = 0;
+		memcpy(s->children, slots, count * sizeof(SEQUENCE));
+		for (size_t i = 0 ; i < count ; ++i)
+		{
+			gc_mark_ptr((void*)&s->children[i]);
+			sizes[i] = length += s->children[i]->length;
+		}
+		s->length = length;
+	}
+	return s;
+}
+
+static size_t seq_child(SEQUENCE s, size_t* i)
+{
+	// Finds the child of a branch holding item *i, and makes *i relative to that child.
+	const size_t* sizes = seq_sizes(s);
+	size_t c = *i >> (SEQUENCE_SHIFT * s->height);
+	if (c >= s->count) c = s->count - 1;
+	while (sizes[c] <= *i) ++c;
+	while (c && sizes[c - 1] > *i) --c;
+	if (c) *i -= sizes[c - 1];
+	return c;
+}
+
+static size_t seq_pack(size_t height, size_t count, const ANY* slots, SEQUENCE out[2])
+{
+	// Fills the first node before starting a second one, so appending leaves full nodes behind.
+	size_t first = count < SEQUENCE_WIDTH ? count : SEQUENCE_WIDTH;
+	out[0] = seq_node(height, first, slots);
+	if (first == count) return 1;
+	out[1] = seq_node(height, count - first, slots + first);
+	return 2;
+}
+
+static size_t seq_join(SEQUENCE a, SEQUENCE b, SEQUENCE out[2])
+{
+	// Joins two trees into one or two nodes as tall as the taller tree.
+	// Nodes along the seam are merged where they fit, so repeated joins don't leave a trail of tiny nodes.
+	ANY slots[2 * SEQUENCE_WIDTH];
+	size_t n = 0;
+	size_t height = a->height > b->height ? a->height : b->height;
+	if (!height)
+	{
+		memcpy(slots, a->items, a->count * sizeof(ANY));
+		memcpy(slots + a->count, b->items, b->count * sizeof(ANY));
+		return seq_pack(0, a->count + b->count, slots, out);
+	}
+	SEQUENCE mid[2];
+	size_t m;
+	if (a->height >= b->height)
+	{
+		n = a->count - 1;
+		memcpy(slots, a->children, n * sizeof(SEQUENCE));
+		m = seq_join(a->children[n], a->height == b->height ? b->children[0] : b, mid);
+	}
+	else m = seq_join(a, b->children[0], mid);
+	memcpy(slots + n, mid, m * sizeof(SEQUENCE));
+	n += m;
+	if (b->height == height)
+	{
+		memcpy(slots + n, b->children + 1, (b->count - 1) * sizeof(SEQUENCE));
+		n += b->count - 1;
+	}
+	return seq_pack(height, n, slots, out);
+}
+
+static SEQUENCE seq_concat(SEQUENCE a, SEQUENCE b)
+{
+	if (!a) return b;
+	if (!b) return a;
+	SEQUENCE out[2];
+	if (seq_join(a, b, out) == 1) return out[0];
+	return seq_node(out[0]->height + 1, 2, out);
+}
+
+static SEQUENCE seq_update(SEQUENCE s, size_t i, ANY a)
+{
+	ANY slots[SEQUENCE_WIDTH];
+	memcpy(slots, s->items, s->count * sizeof(ANY));
+	if (!s->height) slots[i] = a;
+	else
+	{
+		size_t c = seq_child(s, &i);
+		slots[c] = (ANY)seq_update(s->children[c], i, a);
+	}
+	return seq_node(s->height, s->count, slots);
+}
+
+static SEQUENCE seq_take(SEQUENCE s, size_t n)
+{
+	// The first n items, where 0 < n <= length.
+	if (n == s->length) return s;
+	if (!s->height) return seq_node(0, n, s->items);
+	ANY slots[SEQUENCE_WIDTH];
+	size_t i = n - 1;
+	size_t c = seq_child(s, &i);
+	memcpy(slots, s->children, c * sizeof(SEQUENCE));
+	slots[c] = (ANY)seq_take(s->children[c], i + 1);
+	return seq_node(s->height, c + 1, slots);
+}
+
+static SEQUENCE seq_drop(SEQUENCE s, size_t n)
+{
+	// All but the first n items, where 0 <= n < length.
+	if (!n) return s;
+	if (!s->height) return seq_node(0, s->count - n, s->items + n);
+	ANY slots[SEQUENCE_WIDTH];
+	size_t i = n;
+	size_t c = seq_child(s, &i);
+	slots[0] = (ANY)seq_drop(s->children[c], i);
+	memcpy(slots + 1, s->children + c + 1, (s->count - c - 1) * sizeof(SEQUENCE));
+	return seq_node(s->height, s->count - c, slots);
+}
+
+static SEQUENCE seq_trim(SEQUENCE s)
+{
+	// Slicing can leave a chain of single children at the top of the tree.
+	while (s && s->height && s->count == 1) s = s->children[0];
+	return s;
+}
+
+static SEQUENCE seq_from_stack(ANYPTR items, size_t n)
+{
+	// Builds a dense tree bottom up in O(n).
+	// Each level's nodes are boxed into the stack space of the level below, so the GC can see them.
+	if (!n) return NULL;
+	for (size_t height = 0 ; ; ++height)
+	{
+		size_t nodes = 0;
+		for (size_t i = 0 ; i < n ; i += SEQUENCE_WIDTH)
+		{
+			ANY slots[SEQUENCE_WIDTH];
+			size_t count = n - i < SEQUENCE_WIDTH ? n - i : SEQUENCE_WIDTH;
+			for (size_t j = 0 ; j < count ; ++j)
+				slots[j] = height ? (ANY)unbox_SEQUENCE(items[i + j]) : items[i + j];
+			items[nodes++] = box_SEQUENCE(seq_node(height, count, slots));
+		}
+		if (nodes == 1) return unbox_SEQUENCE(items[0]);
+		n = nodes;
+	}
+}
+
+static void seq_flatten(SEQUENCE s)
+{
+	// Pushes the items of s onto the stack in order. O(n).
+	if (!s) return;
+	if (!s->height)
+		for (size_t i = 0 ; i < s->count ; ++i) push(s->items[i]);
+	else
+		for (size_t i = 0 ; i < s->count ; ++i) seq_flatten(s->children[i]);
+}
+
+static size_t seq_index(NUMBER n, SEQUENCE s)
+{
+	size_t length = s ? s->length : 0;
+	if unlikely(n < 0 || n != (size_t)n || (size_t)n >= length)
+		throw_error_fmt("Index %.14g is out of range for a sequence of length %zu", n, length);
+	return n;
+}
+
+static ANY seq_get(SEQUENCE s, size_t i)
+{
+	while (s->height) s = s->children[seq_child(s, &i)];
+	return s->items[i];
+}
+
+static SEQUENCE ___sequence(BLOCK expr)
+{
+	ANYPTR tmp_stack_start = stack.start;
+	stack.start = stack.top;
+	call_block(expr);
+	// The first item is on top of the stack, like in List.
+	for (ANYPTR lo = stack.start, hi = stack.top - 1 ; lo < hi ; ++lo, --hi)
+	{
+		ANY tmp = *lo;
+		*lo = *hi;
+		*hi = tmp;
+	}
+	SEQUENCE s = seq_from_stack(stack.start, stack_length());
+	stack.top = stack.start;
+	stack.start = tmp_stack_start;
+	return s;
+}
+
+static SEQUENCE ___sequenceHfrom(LIST l)
+{
+	ANYPTR base = stack.top;
+	for ( ; l ; l = l->next) push(l->object);
+	SEQUENCE s = seq_from_stack(base, stack.top - base);
+	stack.top = base;
+	return s;
+}
+
+static LIST ___elements_SEQUENCE(SEQUENCE s)
+{
+	ANYPTR base = stack.top;
+	seq_flatten(s);
+	LIST l = NULL;
+	while (stack.top != base) l = ___push(*--stack.top, l);
+	return l;
+}
+
+static SEQUENCE ___update(NUMBER n, SEQUENCE s, ANY a)
+{
+	return seq_update(s, seq_index(n, s), a);
+}
+
+static SEQUENCE ___pushHend(ANY a, SEQUENCE s)
+{
+	// Amortised O(log n), and O(1) space for the new item itself.
+	return seq_concat(s, seq_node(0, 1, &a));
+}
+
+static SEQUENCE ___slice_SEQUENCE(NUMBER startf, NUMBER endf, SEQUENCE s)
+{
+	size_t length = s ? s->length : 0;
+	size_t start = startf;
+	size_t end = endf;
+	if unlikely(startf < 0 || endf < 0 || start != startf || end != endf || start > end || end > length)
+		throw_error_fmt("Invalid range %.14g:%.14g for a sequence of length %zu", startf, endf, length);
+	if (start == end) return NULL;
+	return seq_trim(seq_take(seq_drop(s, start), end - start));
+}
+
+static SEQUENCE ___append_SEQUENCE(SEQUENCE s1, SEQUENCE s2)
+{
+	// O(log n), sharing all but the nodes along the seam.
+	return seq_concat(s2, s1);
+}
+
+static ANY ___first_SEQUENCE(SEQUENCE s)
+{
+	if unlikely(!s) throw_error("empty sequence is invalid");
+	return seq_get(s, 0);
+}
+
+static SEQUENCE ___rest_SEQUENCE(SEQUENCE s)
+{
+	if unlikely(!s) throw_error("empty sequence is invalid");
+	if (s->length == 1) return NULL;
+	return seq_trim(seq_drop(s, 1));
+}
+
+static BOOLEAN ___emptyQ_SEQUENCE(SEQUENCE s)
+{
+	return !s;
+}
+
+static NUMBER ___length_SEQUENCE(SEQUENCE s)
+{
+	return s ? s->length : 0;
+}
+
+static LIST ___elements(ANY a)
+{
+	switch (type_of(a))
+	{
+		case ARRAY_TYPE:    return ___elements_ARRAY(unbox_ARRAY(a));
+		case SEQUENCE_TYPE: return ___elements_SEQUENCE(unbox_SEQUENCE(a));
+		case BYTES_TYPE:    return ___elements_BYTES(unbox_BYTES(a));
+		default: type_error("array or sequence or bytes", a);
+	}
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+static VECTOR vector_alloc(size_t length, size_t capacity)
+{
+	// Both parts live in mutable space, which the GC treats as roots, so no other write barrier is needed.
+	if (capacity < 4) capacity = 4;
+	ANY* items = gc_malloc_mutable(capacity * sizeof(ANY));
+	VECTOR v = gc_malloc_mutable(sizeof *v);
+	v->length = length;
+	v->capacity = capacity;
+	v->items = items;
+	gc_mark_mutable_ptr(&v->items);
+	return v;
+}
+
+static size_t vector_index(NUMBER n, VECTOR v)
+{
+	if unlikely(n < 0 || n != (size_t)n || (size_t)n >= v->length)
+		throw_error_fmt("Index %.14g is out of range for a vector of length %zu", n, v->length);
+	return n;
+}
+
+static VECTOR ___vector(BLOCK expr)
+{
+	ANYPTR tmp_stack_start = stack.start;
+	stack.start = stack.top;
+	call_block(expr);
+	size_t len = stack_length();
+	VECTOR v = vector_alloc(len, len);
+	for (size_t i = 0 ; i < len ; ++i)
+	{
+		v->items[i] = stack.top[-1 - (ptrdiff_t)i];
+		gc_mark_mutable_any(&v->items[i]);
+	}
+	stack.top = stack.start;
+	stack.start = tmp_stack_start;
+	return v;
+}
+
+static VECTOR ___makeHvector(NUMBER n, ANY a)
+{
+	size_t len = n;
+	if unlikely(n < 0 || n != len) throw_error_fmt("Invalid vector length %.14g", n);
+	VECTOR v = vector_alloc(len, len);
+	for (size_t i = 0 ; i < len ; ++i)
+	{
+		v->items[i] = a;
+		gc_mark_mutable_any(&v->items[i]);
+	}
+	return v;
+}
+
+static void ___setHat(NUMBER n, VECTOR v, ANY a)
+{
+	ANY* slot = &v->items[vector_index(n, v)];
+	*slot = a;
+	gc_mark_mutable_any(slot);
+}
+
+static void ___pushHback(ANY a, VECTOR v)
+{
+	// Doubling the capacity makes this amortised O(1).
+	if unlikely(v->length == v->capacity)
+	{
+		ANY* items = gc_malloc_mutable(2 * v->capacity * sizeof(ANY));
+		for (size_t i = 0 ; i < v->length ; ++i)
+		{
+			items[i] = v->items[i];
+			gc_mark_mutable_any(&items[i]);
+		}
+		v->items = items;
+		v->capacity *= 2;
+	}
+	v->items[v->length] = a;
+	gc_mark_mutable_any(&v->items[v->length++]);
+}
+
+static NUMBER ___length_VECTOR(VECTOR v)
+{
+	return v->length;
+}
+
+static BUILDER ___builder(void)
+{
+	BUILDER b = gc_malloc_mutable(sizeof *b);
+	b->bytes = 0;
+	b->capacity = 0;
+	b->data = NULL;
+	gc_mark_mutable_ptr(&b->data);
+	return b;
+}
+
+static void builder_write(BUILDER b, const char* str, size_t bytes)
+{
+	// Doubling the capacity makes each write amortised O(bytes).
+	if unlikely(b->bytes + bytes > b->capacity)
+	{
+		size_t capacity = b->capacity ? 2 * b->capacity : 64;
+		while (capacity < b->bytes + bytes) capacity *= 2;
+		char* data = gc_malloc(capacity);
+		memcpy(data, b->data, b->bytes);
+		b->data = data;
+		b->capacity = capacity;
+	}
+	memcpy(b->data + b->bytes, str, bytes);
+	b->bytes += bytes;
+}
+
+static void builder_write_object(BUILDER b, ANY a)
+{
+	// Strings and symbols are written as they are, like Put, and anything else as it is shown.
+	size_t bytes;
+	STRING str;
+	if (___stringQ(a)) str = string_span(&a, &bytes);
+	else bytes = strlen(str = ___show(a));
+	builder_write(b, str, bytes);
+}
+
+static void ___add(ANY a, BUILDER b)
+{
+	builder_write_object(b, a);
+}
+
+static STRING ___contents(BUILDER b)
+{
+	// The builder can still be written to, so its buffer is copied rather than handed out.
+	char* str = gc_malloc_string(b->bytes);
+	memcpy(str, b->data, b->bytes);
+	return str;
+}
+
+static NUMBER ___length_BUILDER(BUILDER b)
+{
+	return b->bytes;
+}
+
+static STRING ___join(STRING sep, LIST lst)
+{
+	// Lists of strings are measured first so the result is allocated once, without a builder.
+	const size_t sep_bytes = string_bytes(sep);
+	size_t bytes = 0;
+	for (LIST l = lst ; l ; l = l->next)
+	{
+		if unlikely(!___stringQ(l->object))
+		{
+			BUILDER b = ___builder();
+			for (LIST l = lst ; l ; l = l->next)
+			{
+				if (l != lst) builder_write(b, sep, sep_bytes);
+				builder_write_object(b, l->object);
+			}
+			return ___contents(b);
+		}
+		size_t n;
+		string_span(&l->object, &n);
+		bytes += n + (l != lst) * sep_bytes;
+	}
+	char* str = gc_malloc_string(bytes);
+	char* end = str;
+	for (LIST l = lst ; l ; l = l->next)
+	{
+		if (l != lst) end = (char*)memcpy(end, sep, sep_bytes) + sep_bytes;
+		size_t n;
+		STRING s = string_span(&l->object, &n);
+		end = (char*)memcpy(end, s, n) + n;
+	}
+	return str;
+}
+
+static cognate_bytes* bytes_alloc(size_t length)
+{
+	// The data follows the header, so the GC copies both in one piece and never scans the data.
+	cognate_bytes* b = gc_malloc(sizeof *b + length);
+	b->length = length;
+	b->data = length ? (uint8_t*)(b + 1) : NULL; // An empty object's data would point at whatever comes next.
+	gc_mark_ptr((void*)&b->data);
+	return b;
+}
+
+static BYTES bytes_view(const uint8_t* data, size_t length)
+{
+	// Interior pointers keep the whole parent alive, and pointers outside the heap are left alone.
+	cognate_bytes* b = gc_malloc(sizeof *b);
+	b->length = length;
+	b->data = length ? (uint8_t*)data : NULL;
+	gc_mark_ptr((void*)&b->data);
+	return b;
+}
+
+static BYTES ___bytesHfrom(ANY a)
+{
+	// Strings are copied as they are, and lists must hold whole numbers from 0 to 255.
+	switch (type_of(a))
+	{
+		case STRING_TYPE:
+			{
+				size_t n;
+				string_span(&a, &n);
+				cognate_bytes* b = bytes_alloc(n);
+				memcpy(b->data, string_span(&a, &n), n); // Spanned again, as the allocation may have moved the string.
+				return b;
+			}
+		case LIST_TYPE:
+			{
+				LIST lst = unbox_LIST(a);
+				cognate_bytes* b = bytes_alloc(___length_LIST(lst));
+				for (size_t i = 0 ; lst ; lst = lst->next, ++i)
+				{
+					NUMBER n = unbox_NUMBER(lst->object);
+					if unlikely(n < 0 || n > 255 || n != (uint8_t)n) throw_error_fmt("%.14g is not a byte", n);
+					b->data[i] = n;
+				}
+				return b;
+			}
+		default: type_error("list or string", a);
+	}
+	#ifdef __TINYC__
+	return NULL;
+	#endif
+}
+
+static STRING ___stringHfromHbytes(BYTES b)
+{
+	// Strings end at a NUL, so one in the middle would silently truncate them.
+	if unlikely(b->length && memchr(b->data, '\0', b->length)) throw_error("Bytes containing a NUL can't be made into a string");
+	char* str = gc_malloc_string(b->length);
+	if (b->length) memcpy(str, b->data, b->length);
+	return str;
+}
+
+static LIST ___elements_BYTES(BYTES b)
+{
+	LIST lst = NULL;
+	for (size_t i = b->length ; i-- ; ) lst = ___push(box_NUMBER(b->data[i]), lst);
+	return lst;
+}
+
+static NUMBER ___length_BYTES(BYTES b)
+{
+	return b->length;
+}
+
+static BYTES ___slice_BYTES(NUMBER startf, NUMBER endf, BYTES b)
+{
+	// O(1), as the slice shares its parent's data.
+	size_t start = startf;
+	size_t end = endf;
+	if unlikely(startf < 0 || endf < 0 || start != startf || end != endf || start > end || end > b->length)
+		throw_error_fmt("Invalid range %.14g:%.14g for bytes of length %zu", startf, endf, b->length);
+	return bytes_view(b->data + start, end - start);
+}
+
+static ANY ___slice(NUMBER start, NUMBER end, ANY a)
+{
+	switch (type_of(a))
+	{
+		case SEQUENCE_TYPE: return box_SEQUENCE(___slice_SEQUENCE(start, end, unbox_SEQUENCE(a)));
+		case BYTES_TYPE:    return box_BYTES(___slice_BYTES(start, end, unbox_BYTES(a)));
+		default: type_error("sequence or bytes", a);
+	}
+	#ifdef __TINYC__
+	return NIL;
+	#endif
+}
+
+static BYTES ___append_BYTES(BYTES b1, BYTES b2)
+{
+	cognate_bytes* b = bytes_alloc(b1->length + b2->length);
+	if (b2->length) memcpy(b->data, b2->data, b2->length);
+	if (b1->length) memcpy(b->data + b2->length, b1->data, b1->length);
+	return b;
+}
+
+typedef struct packed_format
+{
+	char kind; // 'u' or 'i' for integers, or 'f' for IEEE floats.
+	size_t size;
+	bool big_endian;
+} packed_format;
+
+static packed_format parse_packed_format(SYMBOL sym)
+{
+	// \u8 and \i8 have no byte order, and everything wider needs one, as in \u32-le or \f64-be.
+	packed_format f = { .kind = sym[0] };
+	char* end;
+	unsigned long bits = strtoul(sym + 1, &end, 10);
+	f.size = bits / 8;
+	f.big_endian = !strcmp(end, "-be");
+	bool ordered = f.big_endian || !strcmp(end, "-le");
+	bool valid = (f.kind == 'u' || f.kind == 'i') && (bits == 8 || bits == 16 || bits == 32 || bits == 64);
+	if (f.kind == 'f') valid = bits == 32 || bits == 64;
+	if unlikely(!valid || !isdigit(sym[1]) || ordered != (bits != 8))
+		throw_error_fmt("Unknown format \\%s, expected one like \\u8, \\i16-le, \\u32-be or \\f64-le", sym);
+	return f;
+}
+
+static uint64_t load_little_endian(const uint8_t* p, size_t size)
+{
+	// Compilers turn these loops into a single load, and a byte swap where needed, once size is known.
+	uint64_t x = 0;
+	for (size_t i = 0 ; i < size ; ++i) x |= (uint64_t)p[i] << (8 * i);
+	return x;
+}
+
+static uint64_t load_big_endian(const uint8_t* p, size_t size)
+{
+	uint64_t x = 0;
+	for (size_t i = 0 ; i < size ; ++i) x = (x << 8) | p[i];
+	return x;
+}
+
+static void store_little_endian(uint8_t* p, uint64_t x, size_t size)
+{
+	for (size_t i = 0 ; i < size ; ++i) p[i] = x >> (8 * i);
+}
+
+static void store_big_endian(uint8_t* p, uint64_t x, size_t size)
+{
+	for (size_t i = size ; i-- ; x >>= 8) p[i] = x;
+}
+
+static uint64_t load_packed(const uint8_t* p, packed_format f)
+{
+	// Dispatching on the size first lets each call be inlined with a constant one.
+	switch (f.size)
+	{
+		case 1:  return *p;
+		case 2:  return f.big_endian ? load_big_endian(p, 2) : load_little_endian(p, 2);
+		case 4:  return f.big_endian ? load_big_endian(p, 4) : load_little_endian(p, 4);
+		default: return f.big_endian ? load_big_endian(p, 8) : load_little_endian(p, 8);
+	}
+}
+
+static NUMBER ___unpack(SYMBOL sym, NUMBER offsetf, BYTES b)
+{
+	// 64 bit integers beyond 2^53 are rounded, as every number is a double.
+	packed_format f = parse_packed_format(sym);
+	size_t offset = offsetf;
+	if unlikely(offsetf < 0 || offset != offsetf || offset > b->length || b->length - offset < f.size)
+		throw_error_fmt("Can't unpack \\%s at offset %.14g of bytes of length %zu", sym, offsetf, b->length);
+	uint64_t x = load_packed(b->data + offset, f);
+	const int unused = 64 - 8 * f.size;
+	if (f.kind == 'u') return x;
+	if (f.kind == 'i') return (int64_t)(x << unused) >> unused;
+	NUMBER n;
+	if (f.size == 4)
+	{
+		float n32;
+		uint32_t x32 = x;
+		memcpy(&n32, &x32, sizeof n32);
+		n = n32;
+	}
+	else memcpy(&n, &x, sizeof n);
+	// Other NaNs could have the same bits as a boxed value, so every NaN becomes the one arithmetic makes.
+	return isnan(n) ? NAN : n;
+}
+
+static BYTES ___pack(SYMBOL sym, NUMBER n)
+{
+	// Integers must fit exactly, but floats are rounded to \f32 like C would.
+	packed_format f = parse_packed_format(sym);
+	uint64_t x;
+	if (f.kind == 'f')
+	{
+		if (f.size == 4)
+		{
+			float n32 = n;
+			uint32_t x32;
+			memcpy(&x32, &n32, sizeof x32);
+			x = x32;
+		}
+		else memcpy(&x, &n, sizeof x);
+	}
+	else
+	{
+		const NUMBER limit = ldexp(1, 8 * f.size - (f.kind == 'i'));
+		const NUMBER lowest = f.kind == 'i' ? -limit : 0;
+		if unlikely(n != floor(n) || n < lowest || n >= limit)
+			throw_error_fmt("%.14g doesn't fit in \\%s", n, sym);
+		x = f.kind == 'i' ? (uint64_t)(int64_t)n : (uint64_t)n;
+	}
+	cognate_bytes* b = bytes_alloc(f.size);
+	switch (f.size)
+	{
+		case 1:  b->data[0] = x; break;
+		case 2:  f.big_endian ? store_big_endian(b->data, x, 2) : store_little_endian(b->data, x, 2); break;
+		case 4:  f.big_endian ? store_big_endian(b->data, x, 4) : store_little_endian(b->data, x, 4); break;
+		default: f.big_endian ? store_big_endian(b->data, x, 8) : store_little_endian(b->data, x, 8); break;
+	}
+	return b;
+}
+
+static ANY ___index(NUMBER n, ANY a)
+{
+	// O(1) for vectors, arrays and bytes, O(log n) for sequences, and O(n) for lists and strings.
+	if unlikely(n < 0 || n != (size_t)n) throw_error_fmt("Invalid index %.14g", n);
+	size_t i = n;
+	switch (type_of(a))
+	{
+		case VECTOR_TYPE:
+			{
+				VECTOR v = unbox_VECTOR(a);
+				return v->items[vector_index(n, v)];
+			}
+		case ARRAY_TYPE:
+			return box_NUMBER(___element(n, unbox_ARRAY(a)));
+		case BYTES_TYPE:
+			{
+				BYTES b = unbox_BYTES(a);
+				if (i < b->length) return box_NUMBER(b->data[i]);
+				break;
+			}
+		case SEQUENCE_TYPE:
+			{
+				SEQUENCE s = unbox_SEQUENCE(a);
+				return seq_get(s, seq_index(n, s));
+			}
+		case LIST_TYPE:
+			for (LIST l = unbox_LIST(a) ; l ; l = l->next)
+				if (!i--) return l->object;
+			break;
+		case STRING_TYPE:
+			{
+				size_t bytes;
+				STRING str = string_span(&a, &bytes);
+				for (STRING s = str ; s != str + bytes ; s += char_bytes(s, str + bytes - s))
+					if (!i--) return ___first_STRING(s);
+				break;
+			}
+		default: type_error("list or string or array or vector or sequence or bytes", a);
+	}
+	throw_error_fmt("Index %.14g is beyond the end", n);
+}
+
+static NUMBER ___length(ANY a)
+{
+	switch(type_of(a))
+	{
+		case LIST_TYPE:   return ___length_LIST(unbox_LIST(a));
+		case STRING_TYPE:
+			{
+				if (flat_string(a)) return ___length_STRING(unbox_STRING(a));
+				if (view_of(a)) return view_chars(view_of(a));
+				size_t bytes;
+				STRING str = string_span(&a, &bytes);
+				return count_chars(str, bytes);
+			}
+		case TABLE_TYPE:  return ___length_TABLE(unbox_TABLE(a));
+		case ARRAY_TYPE:  return ___length_ARRAY(unbox_ARRAY(a));
+		case VECTOR_TYPE: return ___length_VECTOR(unbox_VECTOR(a));
+		case SEQUENCE_TYPE: return ___length_SEQUENCE(unbox_SEQUENCE(a));
+		case BUILDER_TYPE: return ___length_BUILDER(unbox_BUILDER(a));
+		case BYTES_TYPE:   return ___length_BYTES(unbox_BYTES(a));
+		default: type_error("list or string or table or array or vector or sequence or builder or bytes", a);
+	}
+#ifdef __TINYC__
+	return 0;
+#endif
+}
+
+static STRING ___show_NUMBER(NUMBER a)
+{
+	show_number(a, (char*)general_purpose_buffer);
+	return gc_strdup((char*)general_purpose_buffer);
+}
+
+static STRING ___show_TABLE(TABLE a)
+{
+	show_table(a, (char*)general_purpose_buffer, NULL);
+	return gc_strdup((char*)general_purpose_buffer);
+}
+
+static STRING ___show_IO(IO a)
+{
+	show_io(a, (char*)general_purpose_buffer);
+	return gc_strdup((char*)general_purpose_buffer);
+}
+
+static STRING ___show_STRING(STRING s)
+{
+	return s;
+}
+
+static STRING ___show_BOOLEAN(BOOLEAN b)
+{
+	return b ? "True" : "False";
+}
+
+static STRING ___show_SYMBOL(SYMBOL s)
+{
+	return s;
+}
+
+static STRING ___show_BLOCK(BLOCK b)
+{
+	show_block(b, (char*)general_purpose_buffer);
+	return gc_strdup((char*)general_purpose_buffer);
+}
+
+static STRING ___show_BOX(BOX b)
+{
+	show_box(b, (char*)general_purpose_buffer, NULL);
+	return gc_strdup((char*)general_purpose_buffer);
+}
+
+static STRING ___show_LIST(LIST l)
+{
+	show_list(l, (char*)general_purpose_buffer, NULL);
+	return gc_strdup((char*)general_purpose_buffer);
+}
+
+
+
+// Regexes are compiled to a Thompson NFA, which is run as a lazily built DFA to find out whether a string matches and
+// as a Pike VM when the sub-expressions are wanted. Both take time linear in the length of the string, unlike libc's
+// backtracking, and behave the same everywhere. The syntax is POSIX extended (with REG_NEWLINE) plus GNU's escapes,
+// except for back-references, which can't be matched in linear time.
+
+#define REGEX_MAX_REPEAT 1000
+#define REGEX_MAX_PROGRAM 100000
+#define REGEX_MAX_DEPTH 1000
+#define REGEX_MAX_STATES 4096
+#define REGEX_DFA_MEMORY 8l*MEGABYTE
+#define REGEX_MAX_CHAR 0x10ffff
+#define REGEX_INVALID 0xffffffff // Bytes that aren't a character in the locale, which nothing matches.
+#define REGEX_END 0xfffffffe     // The end of the string, which only assertions look at.
+#define REGEX_MATCHED 0xffffffff // A DFA transition that found a match.
+
+typedef struct regex_range
+{
+	uint32_t lo, hi;
+} regex_range;
+
+typedef struct regex_inst
+{
+	enum { RE_RANGES, RE_SPLIT, RE_JUMP, RE_SAVE, RE_ASSERT, RE_MATCH } op;
+	uint32_t x, y; // Ranges: offset and count. Split: both targets, x preferred. Jump: target. Save: slot. Assert: kind.
+} regex_inst;
+
+enum { RE_BOL, RE_EOL, RE_TEXT_START, RE_TEXT_END, RE_WORD_BOUNDARY, RE_NOT_WORD_BOUNDARY, RE_WORD_START, RE_WORD_END };
+
+// What came before a position, which is all that ^ and the word assertions need from the past.
+enum { RE_AFTER_START = 1, RE_AFTER_NEWLINE = 2, RE_AFTER_WORD = 4 };
+
+typedef struct regex_node
+{
+	enum { RN_EMPTY, RN_SET, RN_CAT, RN_ALT, RN_REPEAT, RN_GROUP, RN_ASSERT } type;
+	uint32_t a, b; // Cat and alt: children. Repeat and group: child in a. Set: offset and count of ranges. Assert: kind.
+	int min, max;  // Repeat: bounds, with max -1 for no limit. Group: number in min.
+} regex_node;
+
+typedef struct regex_parser
+{
+	const char* s;
+	const char* end;
+	STRING pattern;
+	regex_node* nodes;
+	size_t nnodes, nodes_cap;
+	regex_range* ranges;
+	size_t nranges, ranges_cap;
+	size_t ngroups;
+	bool word;
+} regex_parser;
+
+typedef struct regex_state
+{
+	uint32_t pcs, npcs; // Instructions waiting for the next character, in the regex's pool.
+	uint8_t flags;
+	bool start;         // Just the start of the program, so the prefix can be searched for.
+} regex_state;
+
+typedef struct regex_threads
+{
+	uint32_t* sparse;
+	uint32_t* dense;
+	size_t* caps;
+	uint32_t n;
+} regex_threads;
+
+typedef struct regex_frame
+{
+	uint32_t pc; // UINT32_MAX restores a capture slot.
+	uint32_t slot;
+	size_t old;
+} regex_frame;
+
+typedef struct compiled_regex
+{
+	regex_inst* prog;
+	uint32_t ninsts;
+	regex_range* ranges;
+	size_t ncaps;
+	bool word;
+	char prefix[16]; // Bytes that every match starts with, which memmem can find far faster than the DFA.
+	size_t prefix_len;
+	// Characters no instruction can tell apart share a class, and the DFA has a column per class.
+	uint32_t* bounds;
+	uint32_t nbounds;
+	uint32_t stride; // Classes, then invalid characters, then the end of the string.
+	uint32_t ascii_class[128];
+	regex_state* states;
+	uint32_t nstates, states_cap, max_states;
+	uint32_t* trans; // Next state + 1, REGEX_MATCHED, or 0 if not worked out yet.
+	uint32_t* pool;
+	size_t pool_len, pool_cap;
+	uint32_t* table;
+	uint32_t table_mask;
+	size_t resets;
+	regex_threads sets[2]; // Scratch for the DFA, and the thread lists of the Pike VM.
+	uint32_t* stack;
+	size_t* caps;
+	regex_frame* frames;
+} compiled_regex;
+
+static _Noreturn void regex_error(regex_parser* p, const char* msg)
+{
+	throw_error_fmt("Compile error (%s) in regex '%.32s'", msg, p->pattern);
+}
+
+static size_t regex_decode(const char* s, const char* end, uint32_t* cp)
+{
+	const uint8_t c = *s;
+	if likely(c < 0x80)
+	{
+		*cp = c;
+		return 1;
+	}
+	if (utf8_locale)
+	{
+		const size_t n = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 0;
+		if (!n || c > 0xf4 || (size_t)(end - s) < n) goto invalid;
+		uint32_t v = c & (0x7f >> n);
+		for (size_t i = 1 ; i < n ; ++i)
+		{
+			if (((uint8_t)s[i] & 0xc0) != 0x80) goto invalid;
+			v = v << 6 | ((uint8_t)s[i] & 0x3f);
+		}
+		*cp = v;
+		return n;
+	}
+	wchar_t w;
+	mbstate_t state = {0};
+	const size_t n = mbrtowc(&w, s, end - s, &state);
+	if (n && n <= (size_t)(end - s))
+	{
+		*cp = w;
+		return n;
+	}
+invalid:
+	*cp = REGEX_INVALID;
+	return 1;
+}
+
+static bool regex_is_word(uint32_t cp)
+{
+	return cp == '_' || (cp < REGEX_END && iswalnum(cp));
+}
+
+static int regex_compare_ranges(const void* a, const void* b)
+{
+	const regex_range* x = a;
+	const regex_range* y = b;
+	return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+static int regex_compare_pcs(const void* a, const void* b)
+{
+	const uint32_t x = *(const uint32_t*)a;
+	const uint32_t y = *(const uint32_t*)b;
+	return (x > y) - (x < y);
+}
+
+static void regex_add_range(regex_range** ranges, size_t* n, size_t* cap, uint32_t lo, uint32_t hi)
+{
+	if (*n == *cap) *ranges = realloc(*ranges, (*cap = *cap * 2 + 16) * sizeof **ranges);
+	(*ranges)[(*n)++] = (regex_range){lo, hi};
+}
+
+static const regex_range* regex_class_ranges(wctype_t type, size_t* n)
+{
+	// Classes cover every character the locale knows about, so they're worked out once per class and kept.
+	static struct regex_class { wctype_t type; regex_range* ranges; size_t n; } classes[16];
+	static size_t nclasses = 0;
+	for (size_t i = 0 ; i < nclasses ; ++i)
+		if (classes[i].type == type) return *n = classes[i].n, classes[i].ranges;
+	regex_range* ranges = NULL;
+	size_t count = 0, cap = 0;
+	for (uint32_t c = 0 ; c <= REGEX_MAX_CHAR ; ++c)
+	{
+		if (!iswctype(c, type)) continue;
+		if (count && ranges[count - 1].hi == c - 1) ranges[count - 1].hi = c;
+		else regex_add_range(&ranges, &count, &cap, c, c);
+	}
+	if (nclasses < sizeof classes / sizeof classes[0]) classes[nclasses++] = (struct regex_class){type, ranges, count};
+	*n = count;
+	return ranges;
+}
+
+static void regex_add_class(regex_range** ranges, size_t* n, size_t* cap, const char* name)
+{
+	size_t count;
+	const regex_range* class = regex_class_ranges(wctype(name), &count);
+	for (size_t i = 0 ; i < count ; ++i) regex_add_range(ranges, n, cap, class[i].lo, class[i].hi);
+}
+
+static uint32_t regex_node_new(regex_parser* p, regex_node node)
+{
+	if (p->nnodes == p->nodes_cap) p->nodes = realloc(p->nodes, (p->nodes_cap = p->nodes_cap * 2 + 16) * sizeof *p->nodes);
+	p->nodes[p->nnodes] = node;
+	return p->nnodes++;
+}
+
+static uint32_t regex_set(regex_parser* p, regex_range* ranges, size_t n, bool negate)
+{
+	// Sorts and merges the ranges, or takes their complement, so matching a character is a binary search.
+	qsort(ranges, n, sizeof *ranges, regex_compare_ranges);
+	size_t merged = 0;
+	for (size_t i = 0 ; i < n ; ++i)
+	{
+		if (merged && ranges[i].lo <= ranges[merged - 1].hi + 1)
+		{
+			if (ranges[i].hi > ranges[merged - 1].hi) ranges[merged - 1].hi = ranges[i].hi;
+		}
+		else ranges[merged++] = ranges[i];
+	}
+	const size_t offset = p->nranges;
+	uint32_t lo = 0;
+	for (size_t i = 0 ; i <= merged ; ++i)
+	{
+		if (!negate)
+		{
+			if (i < merged) regex_add_range(&p->ranges, &p->nranges, &p->ranges_cap, ranges[i].lo, ranges[i].hi);
+			continue;
+		}
+		const uint32_t hi = i < merged ? ranges[i].lo : REGEX_MAX_CHAR + 1;
+		if (lo < hi) regex_add_range(&p->ranges, &p->nranges, &p->ranges_cap, lo, hi - 1);
+		if (i < merged) lo = ranges[i].hi + 1;
+	}
+	return regex_node_new(p, (regex_node){.type=RN_SET, .a=offset, .b=p->nranges - offset});
+}
+
+static uint32_t regex_bracket_char(regex_parser* p)
+{
+	// A character in a bracket expression, which may be a collating element like [.-.] or an equivalence class.
+	if (p->s + 1 < p->end && p->s[0] == '[' && (p->s[1] == '.' || p->s[1] == '='))
+	{
+		const char kind = p->s[1];
+		uint32_t cp;
+		p->s += 2;
+		if (p->s >= p->end) regex_error(p, "Unmatched [, [^, [:, [., or [=");
+		p->s += regex_decode(p->s, p->end, &cp);
+		if (p->s + 1 >= p->end || p->s[0] != kind || p->s[1] != ']') regex_error(p, "Invalid collation character");
+		p->s += 2;
+		return cp;
+	}
+	uint32_t cp;
+	p->s += regex_decode(p->s, p->end, &cp);
+	if (cp == REGEX_INVALID) regex_error(p, "Invalid character");
+	return cp;
+}
+
+static uint32_t regex_bracket(regex_parser* p)
+{
+	regex_range* ranges = NULL;
+	size_t n = 0, cap = 0;
+	const bool negate = p->s < p->end && *p->s == '^';
+	if (negate) p->s++;
+	for (bool first = true ;; first = false)
+	{
+		if (p->s >= p->end) regex_error(p, "Unmatched [, [^, [:, [., or [=");
+		if (*p->s == ']' && !first)
+		{
+			p->s++;
+			break;
+		}
+		if (p->s + 1 < p->end && p->s[0] == '[' && p->s[1] == ':')
+		{
+			const char* name = p->s + 2;
+			const char* close = name;
+			while (close + 1 < p->end && !(close[0] == ':' && close[1] == ']')) close++;
+			if (close + 1 >= p->end) regex_error(p, "Unmatched [, [^, [:, [., or [=");
+			char buf[32];
+			if ((size_t)(close - name) >= sizeof buf) regex_error(p, "Invalid character class name");
+			memcpy(buf, name, close - name);
+			buf[close - name] = '\0';
+			if (!wctype(buf)) regex_error(p, "Invalid character class name");
+			regex_add_class(&ranges, &n, &cap, buf);
+			p->s = close + 2;
+			continue;
+		}
+		const uint32_t lo = regex_bracket_char(p);
+		uint32_t hi = lo;
+		if (p->s + 1 < p->end && p->s[0] == '-' && p->s[1] != ']')
+		{
+			p->s++;
+			hi = regex_bracket_char(p);
+			if (hi < lo) regex_error(p, "Invalid range end");
+		}
+		regex_add_range(&ranges, &n, &cap, lo, hi);
+	}
+	// Negated brackets don't match newlines, as with REG_NEWLINE.
+	if (negate) regex_add_range(&ranges, &n, &cap, '\n', '\n');
+	const uint32_t node = regex_set(p, ranges, n, negate);
+	free(ranges);
+	return node;
+}
+
+static uint32_t regex_named_set(regex_parser* p, const char* class, bool negate)
+{
+	// \W and \S are complements too, but they do match newlines.
+	regex_range* ranges = NULL;
+	size_t n = 0, cap = 0;
+	regex_add_class(&ranges, &n, &cap, class);
+	if (class[0] == 'a') regex_add_range(&ranges, &n, &cap, '_', '_'); // \w is [_[:alnum:]]
+	const uint32_t node = regex_set(p, ranges, n, negate);
+	free(ranges);
+	return node;
+}
+
+static uint32_t regex_parse_alt(regex_parser*, int);
+
+static uint32_t regex_parse_atom(regex_parser* p, int depth)
+{
+	const char c = *p->s;
+	switch (c)
+	{
+		case '(':
+		{
+			p->s++;
+			const size_t group = ++p->ngroups;
+			const uint32_t child = regex_parse_alt(p, depth + 1);
+			if (p->s >= p->end || *p->s != ')') regex_error(p, "Unmatched ( or \\(");
+			p->s++;
+			return regex_node_new(p, (regex_node){.type=RN_GROUP, .a=child, .min=group});
+		}
+		case '[':
+			p->s++;
+			return regex_bracket(p);
+		case '.':
+		{
+			p->s++;
+			regex_range newline = {'\n', '\n'};
+			return regex_set(p, &newline, 1, true);
+		}
+		case '^':
+			p->s++;
+			return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_BOL});
+		case '$':
+			p->s++;
+			return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_EOL});
+		case '*': case '+': case '?': case '{':
+			regex_error(p, "Invalid preceding regular expression");
+		case '\\':
+			if (++p->s >= p->end) regex_error(p, "Trailing backslash");
+			switch (*p->s)
+			{
+				case 'w': p->s++; p->word = true; return regex_named_set(p, "alnum", false);
+				case 'W': p->s++; p->word = true; return regex_named_set(p, "alnum", true);
+				case 's': p->s++; return regex_named_set(p, "space", false);
+				case 'S': p->s++; return regex_named_set(p, "space", true);
+				case 'b': p->s++; p->word = true; return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_WORD_BOUNDARY});
+				case 'B': p->s++; p->word = true; return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_NOT_WORD_BOUNDARY});
+				case '<': p->s++; p->word = true; return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_WORD_START});
+				case '>': p->s++; p->word = true; return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_WORD_END});
+				case '`': p->s++; return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_TEXT_START});
+				case '\'': p->s++; return regex_node_new(p, (regex_node){.type=RN_ASSERT, .a=RE_TEXT_END});
+			}
+			if (*p->s >= '1' && *p->s <= '9') regex_error(p, "Back-references are not supported");
+			// fallthrough
+		default:
+		{
+			uint32_t cp;
+			p->s += regex_decode(p->s, p->end, &cp);
+			if (cp == REGEX_INVALID) regex_error(p, "Invalid character");
+			regex_range r = {cp, cp};
+			return regex_set(p, &r, 1, false);
+		}
+	}
+}
+
+static int regex_parse_count(regex_parser* p)
+{
+	if (p->s >= p->end || !isdigit((uint8_t)*p->s)) return -1;
+	int n = 0;
+	while (p->s < p->end && isdigit((uint8_t)*p->s))
+	{
+		n = n * 10 + (*p->s++ - '0');
+		if (n > REGEX_MAX_REPEAT) regex_error(p, "Regular expression too big");
+	}
+	return n;
+}
+
+static uint32_t regex_parse_repeat(regex_parser* p, int depth)
+{
+	uint32_t node = regex_parse_atom(p, depth);
+	while (p->s < p->end)
+	{
+		int min, max;
+		switch (*p->s)
+		{
+			case '*': min = 0; max = -1; break;
+			case '+': min = 1; max = -1; break;
+			case '?': min = 0; max = 1; break;
+			case '{':
+			{
+				p->s++;
+				min = regex_parse_count(p);
+				max = min;
+				if (p->s < p->end && *p->s == ',')
+				{
+					p->s++;
+					if (min == -1) min = 0;
+					max = regex_parse_count(p);
+				}
+				if (p->s >= p->end) regex_error(p, "Unmatched \\{");
+				if (min == -1 || *p->s != '}' || (max != -1 && max < min)) regex_error(p, "Invalid content of \\{\\}");
+				break;
+			}
+			default: return node;
+		}
+		p->s++;
+		if (p->nodes[node].type == RN_ASSERT) regex_error(p, "Invalid preceding regular expression");
+		node = regex_node_new(p, (regex_node){.type=RN_REPEAT, .a=node, .min=min, .max=max});
+	}
+	return node;
+}
+
+static uint32_t regex_parse_alt(regex_parser* p, int depth)
+{
+	if (depth > REGEX_MAX_DEPTH) regex_error(p, "Regular expression too big");
+	uint32_t alt = UINT32_MAX;
+	for (;;)
+	{
+		uint32_t cat = UINT32_MAX;
+		while (p->s < p->end && *p->s != '|' && *p->s != ')')
+		{
+			const uint32_t next = regex_parse_repeat(p, depth);
+			cat = cat == UINT32_MAX ? next : regex_node_new(p, (regex_node){.type=RN_CAT, .a=cat, .b=next});
+		}
+		if (cat == UINT32_MAX) cat = regex_node_new(p, (regex_node){.type=RN_EMPTY});
+		alt = alt == UINT32_MAX ? cat : regex_node_new(p, (regex_node){.type=RN_ALT, .a=alt, .b=cat});
+		if (p->s >= p->end || *p->s != '|') return alt;
+		p->s++;
+	}
+}
+
+static uint32_t regex_emit(regex_parser* p, compiled_regex* re, regex_inst inst)
+{
+	if (re->ninsts == REGEX_MAX_PROGRAM) regex_error(p, "Regular expression too big");
+	re->prog[re->ninsts] = inst;
+	return re->ninsts++;
+}
+
+static void regex_compile_node(regex_parser* p, compiled_regex* re, uint32_t n)
+{
+	const regex_node node = p->nodes[n];
+	switch (node.type)
+	{
+		case RN_EMPTY: break;
+		case RN_SET: regex_emit(p, re, (regex_inst){.op=RE_RANGES, .x=node.a, .y=node.b}); break;
+		case RN_ASSERT: regex_emit(p, re, (regex_inst){.op=RE_ASSERT, .x=node.a}); break;
+		case RN_CAT:
+			regex_compile_node(p, re, node.a);
+			regex_compile_node(p, re, node.b);
+			break;
+		case RN_ALT:
+		{
+			const uint32_t split = regex_emit(p, re, (regex_inst){.op=RE_SPLIT});
+			re->prog[split].x = re->ninsts;
+			regex_compile_node(p, re, node.a);
+			const uint32_t jump = regex_emit(p, re, (regex_inst){.op=RE_JUMP});
+			re->prog[split].y = re->ninsts;
+			regex_compile_node(p, re, node.b);
+			re->prog[jump].x = re->ninsts;
+			break;
+		}
+		case RN_GROUP:
+			regex_emit(p, re, (regex_inst){.op=RE_SAVE, .x=2 * node.min});
+			regex_compile_node(p, re, node.a);
+			regex_emit(p, re, (regex_inst){.op=RE_SAVE, .x=2 * node.min + 1});
+			break;
+		case RN_REPEAT:
+		{
+			for (int i = 0 ; i < node.min ; ++i) regex_compile_node(p, re, node.a);
+			if (node.max == -1)
+			{
+				const uint32_t split = regex_emit(p, re, (regex_inst){.op=RE_SPLIT});
+				re->prog[split].x = re->ninsts;
+				regex_compile_node(p, re, node.a);
+				regex_emit(p, re, (regex_inst){.op=RE_JUMP, .x=split});
+				re->prog[split].y = re->ninsts;
+				break;
+			}
+			// Each optional copy can be skipped straight to the end. The splits are chained through y until then.
+			uint32_t chain = UINT32_MAX;
+			for (int i = node.min ; i < node.max ; ++i)
+			{
+				const uint32_t split = regex_emit(p, re, (regex_inst){.op=RE_SPLIT, .y=chain});
+				re->prog[split].x = re->ninsts;
+				regex_compile_node(p, re, node.a);
+				chain = split;
+			}
+			while (chain != UINT32_MAX)
+			{
+				const uint32_t prev = re->prog[chain].y;
+				re->prog[chain].y = re->ninsts;
+				chain = prev;
+			}
+			break;
+		}
+	}
+}
+
+static bool regex_find_prefix(regex_parser* p, compiled_regex* re, uint32_t n)
+{
+	// Collects the literal characters every match starts with, returning whether the whole node was literal.
+	const regex_node node = p->nodes[n];
+	switch (node.type)
+	{
+		case RN_CAT: return regex_find_prefix(p, re, node.a) && regex_find_prefix(p, re, node.b);
+		case RN_GROUP: return regex_find_prefix(p, re, node.a);
+		case RN_REPEAT:
+			if (node.min > 0) regex_find_prefix(p, re, node.a);
+			return false;
+		case RN_SET:
+		{
+			if (node.b != 1 || p->ranges[node.a].lo != p->ranges[node.a].hi) return false;
+			char mb[MB_LEN_MAX];
+			mbstate_t state = {0};
+			const size_t bytes = wcrtomb(mb, p->ranges[node.a].lo, &state);
+			if (bytes > MB_LEN_MAX || re->prefix_len + bytes > sizeof re->prefix) return false;
+			memcpy(re->prefix + re->prefix_len, mb, bytes);
+			re->prefix_len += bytes;
+			return true;
+		}
+		default: return false;
+	}
+}
+
+static uint32_t regex_class(compiled_regex* re, uint32_t cp)
+{
+	if unlikely(cp == REGEX_INVALID) return re->nbounds + 1;
+	uint32_t lo = 0, hi = re->nbounds;
+	while (lo < hi)
+	{
+		const uint32_t mid = (lo + hi) / 2;
+		if (re->bounds[mid] <= cp) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+static void regex_add_bound(compiled_regex* re, size_t* cap, uint32_t b)
+{
+	if (b == 0 || b > REGEX_MAX_CHAR) return;
+	if (re->nbounds == *cap) re->bounds = realloc(re->bounds, (*cap = *cap * 2 + 16) * sizeof *re->bounds);
+	re->bounds[re->nbounds++] = b;
+}
+
+static void regex_dfa_reset(compiled_regex* re)
+{
+	re->nstates = 0;
+	re->pool_len = 0;
+	re->resets++;
+	memset(re->table, 0, (re->table_mask + 1) * sizeof *re->table);
+}
+
+static compiled_regex* compile_regex(STRING reg_str)
+{
+	regex_parser p = { .s = reg_str, .end = reg_str + strlen(reg_str), .pattern = reg_str };
+	const uint32_t root = regex_parse_alt(&p, 0);
+	if (p.s < p.end) regex_error(&p, "Unmatched ) or \\)");
+
+	compiled_regex* re = calloc(1, sizeof *re);
+	re->prog = malloc(REGEX_MAX_PROGRAM * sizeof *re->prog);
+	regex_emit(&p, re, (regex_inst){.op=RE_SAVE, .x=0});
+	regex_compile_node(&p, re, root);
+	regex_emit(&p, re, (regex_inst){.op=RE_SAVE, .x=1});
+	regex_emit(&p, re, (regex_inst){.op=RE_MATCH});
+	re->prog = realloc(re->prog, re->ninsts * sizeof *re->prog);
+	re->ranges = p.ranges;
+	re->ncaps = 2 * (p.ngroups + 1);
+	re->word = p.word;
+	regex_find_prefix(&p, re, root);
+	free(p.nodes);
+
+	// Newlines and word characters are told apart from the rest when assertions need them.
+	size_t cap = 0;
+	for (size_t i = 0 ; i < p.nranges ; ++i)
+	{
+		regex_add_bound(re, &cap, p.ranges[i].lo);
+		regex_add_bound(re, &cap, p.ranges[i].hi + 1);
+	}
+	regex_add_bound(re, &cap, '\n');
+	regex_add_bound(re, &cap, '\n' + 1);
+	if (re->word)
+	{
+		size_t n;
+		const regex_range* word = regex_class_ranges(wctype("alnum"), &n);
+		for (size_t i = 0 ; i < n ; ++i)
+		{
+			regex_add_bound(re, &cap, word[i].lo);
+			regex_add_bound(re, &cap, word[i].hi + 1);
+		}
+		regex_add_bound(re, &cap, '_');
+		regex_add_bound(re, &cap, '_' + 1);
+	}
+	qsort(re->bounds, re->nbounds, sizeof *re->bounds, regex_compare_pcs);
+	uint32_t unique = 0;
+	for (uint32_t i = 0 ; i < re->nbounds ; ++i)
+		if (!unique || re->bounds[i] != re->bounds[unique - 1]) re->bounds[unique++] = re->bounds[i];
+	re->nbounds = unique;
+	for (uint32_t c = 0 ; c < 128 ; ++c) re->ascii_class[c] = regex_class(re, c);
+	re->stride = re->nbounds + 3;
+
+	re->max_states = REGEX_DFA_MEMORY / (re->stride * sizeof *re->trans);
+	if (re->max_states > REGEX_MAX_STATES) re->max_states = REGEX_MAX_STATES;
+	if (re->max_states < 16) re->max_states = 16;
+	uint32_t table_size = 1;
+	while (table_size < 2 * re->max_states) table_size *= 2;
+	re->table = malloc(table_size * sizeof *re->table);
+	re->table_mask = table_size - 1;
+	for (int i = 0 ; i < 2 ; ++i)
+	{
+		re->sets[i].sparse = malloc(re->ninsts * sizeof *re->sets[i].sparse);
+		re->sets[i].dense = malloc(re->ninsts * sizeof *re->sets[i].dense);
+	}
+	re->stack = malloc(3 * re->ninsts * sizeof *re->stack);
+	regex_dfa_reset(re);
+	return re;
+}
+
+static bool regex_set_has(regex_threads* set, uint32_t pc)
 {
-	return NULL;
+	return set->sparse[pc] < set->n && set->dense[set->sparse[pc]] == pc;
 }
 
-static TABLE ___table (BLOCK expr)
+static void regex_set_add(regex_threads* set, uint32_t pc)
 {
-	ANYPTR tmp_stack_start = stack.start;
-	stack.start = stack.top;
-	// Eval expr
-	call_block(expr);
-	// Move to a table.
-	TABLE d = NULL;
-	size_t len = stack_length();
-	if unlikely(len & 1) throw_error("Table initialiser must be key-value pairs");
-	for (size_t i = 0; i < len; i += 2)
+	set->sparse[pc] = set->n;
+	set->dense[set->n++] = pc;
+}
+
+static bool regex_in_ranges(const regex_range* ranges, uint32_t n, uint32_t cp)
+{
+	uint32_t lo = 0, hi = n;
+	while (lo < hi)
 	{
-		ANY key = stack.start[i+1];
-		ANY value = stack.start[i];
-		d = ___insert(key, value, d);
+		const uint32_t mid = (lo + hi) / 2;
+		if (ranges[mid].hi < cp) lo = mid + 1;
+		else if (ranges[mid].lo > cp) hi = mid;
+		else return true;
 	}
-	stack.top = stack.start;
-	stack.start = tmp_stack_start;
-	return d;
+	return false;
 }
 
-static TABLE mktable(ANY key, ANY value, TABLE left, TABLE right, size_t level)
+static bool regex_assert(uint32_t kind, uint8_t flags, uint32_t next)
 {
-	TABLE t = gc_malloc(sizeof *t);
-	t->key = key;
-	t->value = value;
-	t->left = left;
-	t->right = right;
-	t->level = level;
-	gc_mark_ptr((void*)&t->left);
-	gc_mark_ptr((void*)&t->right);
-	gc_mark_any(&t->key);
-	gc_mark_any(&t->value);
-	return t;
+	const bool prev_word = flags & RE_AFTER_WORD;
+	const bool next_word = regex_is_word(next);
+	switch (kind)
+	{
+		case RE_BOL: return flags & (RE_AFTER_START | RE_AFTER_NEWLINE);
+		case RE_EOL: return next == REGEX_END || next == '\n';
+		case RE_TEXT_START: return flags & RE_AFTER_START;
+		case RE_TEXT_END: return next == REGEX_END;
+		case RE_WORD_BOUNDARY: return prev_word != next_word;
+		case RE_NOT_WORD_BOUNDARY: return prev_word == next_word;
+		case RE_WORD_START: return !prev_word && next_word;
+		case RE_WORD_END: return prev_word && !next_word;
+	}
+	return false;
 }
 
-static TABLE ___insert(ANY key, ANY value, TABLE d)
+static uint8_t regex_flags(compiled_regex* re, uint32_t cp)
 {
-	cognate_type t = TYPE_MASK & key;
-	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
-	if (!d) return mktable(key, value, NULL, NULL, 1);
-	ptrdiff_t diff = compare_objects(d->key, key);
-	if (diff == 0) return mktable(key, value, d->left, d->right, d->level);
-	if (diff > 0)
-		return
-			table_split(table_skew(
-				mktable(d->key, d->value, ___insert(key, value, d->left), d->right, d->level)));
-	else //if (diff < 0)
-		return
-			table_split(table_skew(
-				mktable(d->key, d->value, d->left, ___insert(key, value, d->right), d->level)));
+	return (cp == '\n' ? RE_AFTER_NEWLINE : 0) | (re->word && regex_is_word(cp) ? RE_AFTER_WORD : 0);
 }
 
-static ANY ___D(ANY key, TABLE d)
+static uint8_t regex_flags_before(compiled_regex* re, const char* str, const char* p)
 {
-	cognate_type t = TYPE_MASK & key;
-	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
-	while (d)
+	if (p == str) return RE_AFTER_START;
+	const char* c = p - 1;
+	if (utf8_locale) while (c > str && p - c < 4 && ((uint8_t)*c & 0xc0) == 0x80) c--;
+	uint32_t cp;
+	regex_decode(c, p, &cp);
+	return regex_flags(re, cp);
+}
+
+static uint32_t regex_intern(compiled_regex* re, const uint32_t* pcs, uint32_t npcs, uint8_t flags)
+{
+	uint64_t hash = flags;
+	for (uint32_t i = 0 ; i < npcs ; ++i) hash = (hash ^ pcs[i]) * 0x100000001b3;
+	uint32_t slot = hash & re->table_mask;
+	for ( ; re->table[slot] ; slot = (slot + 1) & re->table_mask)
 	{
-		ptrdiff_t diff = compare_objects(d->key, key);
-		if (diff == 0) return d->value;
-		else if (diff > 0) d = d->left;
-		else d = d->right;
+		const regex_state* st = re->states + re->table[slot] - 1;
+		if (st->flags == flags && st->npcs == npcs && !memcmp(re->pool + st->pcs, pcs, npcs * sizeof *pcs))
+			return re->table[slot] - 1;
+	}
+	if unlikely(re->nstates == re->max_states)
+	{
+		// The cache is thrown away when it's full, so a pathological regex can't use more memory than this.
+		regex_dfa_reset(re);
+		return regex_intern(re, pcs, npcs, flags);
+	}
+	if (re->nstates == re->states_cap)
+	{
+		re->states_cap = re->states_cap ? re->states_cap * 2 : 16;
+		if (re->states_cap > re->max_states) re->states_cap = re->max_states;
+		re->states = realloc(re->states, re->states_cap * sizeof *re->states);
+		re->trans = realloc(re->trans, (size_t)re->states_cap * re->stride * sizeof *re->trans);
 	}
+	if (re->pool_len + npcs > re->pool_cap)
+		re->pool = realloc(re->pool, (re->pool_cap = (re->pool_len + npcs) * 2) * sizeof *re->pool);
+	memcpy(re->pool + re->pool_len, pcs, npcs * sizeof *pcs);
+	const uint32_t s = re->nstates++;
+	re->states[s] = (regex_state){ .pcs = re->pool_len, .npcs = npcs, .flags = flags, .start = npcs == 1 && pcs[0] == 0 };
+	re->pool_len += npcs;
+	memset(re->trans + (size_t)s * re->stride, 0, re->stride * sizeof *re->trans);
+	re->table[slot] = s + 1;
+	return s;
+}
 
-	throw_error_fmt("%s is not in table", ___show(key));
-	#ifdef __TINYC__
-	return NIL;
-	#endif
+static uint32_t regex_dfa_step(compiled_regex* re, uint32_t s, uint32_t column)
+{
+	// Follows every instruction of the state that doesn't consume a character, then every one that consumes this one.
+	const uint32_t end = re->nbounds + 2;
+	const uint32_t next = column == end ? REGEX_END
+	                    : column == end - 1 ? REGEX_INVALID
+	                    : column ? re->bounds[column - 1] : 0;
+	const regex_state st = re->states[s];
+	regex_threads* seen = &re->sets[0];
+	regex_threads* out = &re->sets[1];
+	seen->n = out->n = 0;
+	size_t top = 0;
+	for (uint32_t i = st.npcs ; i-- ; ) re->stack[top++] = re->pool[st.pcs + i];
+	bool matched = false;
+	while (top)
+	{
+		const uint32_t pc = re->stack[--top];
+		if (regex_set_has(seen, pc)) continue;
+		regex_set_add(seen, pc);
+		const regex_inst inst = re->prog[pc];
+		switch (inst.op)
+		{
+			case RE_RANGES:
+				if (next < REGEX_END && regex_in_ranges(re->ranges + inst.x, inst.y, next) && !regex_set_has(out, pc + 1))
+					regex_set_add(out, pc + 1);
+				break;
+			case RE_SPLIT: re->stack[top++] = inst.y; re->stack[top++] = inst.x; break;
+			case RE_JUMP: re->stack[top++] = inst.x; break;
+			case RE_SAVE: re->stack[top++] = pc + 1; break;
+			case RE_ASSERT: if (regex_assert(inst.x, st.flags, next)) re->stack[top++] = pc + 1; break;
+			case RE_MATCH: matched = true; break;
+		}
+	}
+	uint32_t t;
+	if (matched) t = REGEX_MATCHED;
+	else if (column == end) t = 1;
+	else
+	{
+		// The start of the program is always waiting, since a match can start anywhere.
+		if (!regex_set_has(out, 0)) regex_set_add(out, 0);
+		qsort(out->dense, out->n, sizeof *out->dense, regex_compare_pcs);
+		const size_t resets = re->resets;
+		t = regex_intern(re, out->dense, out->n, regex_flags(re, next)) + 1;
+		if (resets != re->resets) return t;
+	}
+	re->trans[(size_t)s * re->stride + column] = t;
+	return t;
 }
 
-static BOOLEAN ___has(ANY key, TABLE d)
+static uint32_t regex_start(compiled_regex* re, const char* str, const char* p)
 {
-	cognate_type t = TYPE_MASK & key;
-	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
-	while (d)
+	const uint32_t start = 0;
+	return regex_intern(re, &start, 1, regex_flags_before(re, str, p));
+}
+
+static bool regex_search(compiled_regex* re, const char* str, size_t from, size_t len)
+{
+	const char* p = str + from;
+	const char* const end = str + len;
+	uint32_t s = regex_start(re, str, p);
+	for (;;)
 	{
-		ptrdiff_t diff = compare_objects(d->key, key);
-		if (diff == 0) return true;
-		else if (diff > 0) d = d->left;
-		else d = d->right;
+		if (re->prefix_len && re->states[s].start)
+		{
+			// Nothing is partly matched, so the DFA can skip to the next place the prefix appears.
+			const char* found = memmem(p, end - p, re->prefix, re->prefix_len);
+			if (!found) return false;
+			if (found != p) s = regex_start(re, str, p = found);
+		}
+		if unlikely(p == end) break;
+		uint32_t column;
+		size_t n = 1;
+		if likely((uint8_t)*p < 0x80) column = re->ascii_class[(uint8_t)*p];
+		else
+		{
+			uint32_t cp;
+			n = regex_decode(p, end, &cp);
+			column = regex_class(re, cp);
+		}
+		uint32_t t = re->trans[(size_t)s * re->stride + column];
+		if unlikely(!t) t = regex_dfa_step(re, s, column);
+		if (t == REGEX_MATCHED) return true;
+		s = t - 1;
+		p += n;
 	}
+	uint32_t t = re->trans[(size_t)s * re->stride + re->nbounds + 2];
+	if (!t) t = regex_dfa_step(re, s, re->nbounds + 2);
+	return t == REGEX_MATCHED;
+}
 
-	return false;
+static void regex_add_thread(compiled_regex* re, regex_threads* list, uint32_t pc, const size_t* caps, size_t pos, uint8_t flags, uint32_t next)
+{
+	// Follows the instructions that don't consume characters, recording positions in caps as it goes.
+	size_t* cur = re->caps;
+	memcpy(cur, caps, re->ncaps * sizeof *cur);
+	size_t top = 0;
+	re->frames[top++] = (regex_frame){ .pc = pc };
+	while (top)
+	{
+		const regex_frame f = re->frames[--top];
+		if (f.pc == UINT32_MAX)
+		{
+			cur[f.slot] = f.old;
+			continue;
+		}
+		if (regex_set_has(list, f.pc)) continue;
+		regex_set_add(list, f.pc);
+		const regex_inst inst = re->prog[f.pc];
+		switch (inst.op)
+		{
+			case RE_RANGES:
+			case RE_MATCH:
+				memcpy(list->caps + (list->n - 1) * re->ncaps, cur, re->ncaps * sizeof *cur);
+				break;
+			case RE_SPLIT:
+				re->frames[top++] = (regex_frame){ .pc = inst.y };
+				re->frames[top++] = (regex_frame){ .pc = inst.x };
+				break;
+			case RE_JUMP: re->frames[top++] = (regex_frame){ .pc = inst.x }; break;
+			case RE_SAVE:
+				re->frames[top++] = (regex_frame){ .pc = UINT32_MAX, .slot = inst.x, .old = cur[inst.x] };
+				cur[inst.x] = pos;
+				re->frames[top++] = (regex_frame){ .pc = f.pc + 1 };
+				break;
+			case RE_ASSERT:
+				if (regex_assert(inst.x, flags, next)) re->frames[top++] = (regex_frame){ .pc = f.pc + 1 };
+				break;
+		}
+	}
 }
 
-static TABLE ___remove(ANY key, TABLE T)
+static bool regex_captures(compiled_regex* re, const char* str, size_t from, size_t len, size_t* best)
 {
-	// input: X, the key to delete, and T, the root of the tree from which it should be deleted.
-   // output: T, balanced, without the value X.
-	cognate_type t = TYPE_MASK & key;
-	if unlikely(t == IO_TYPE || t == BLOCK_TYPE || t == BOX_TYPE) throw_error_fmt("Can't index a table with %s", ___show(key));
-	if (!T) throw_error_fmt("Key %s not in table", ___show(key));
-	ptrdiff_t diff = compare_objects(T->key, key);
-	TABLE T2 = NULL;
-	// This part is fairly intuitive - if this breaks it's probably not here:
-	if (diff < 0)
-		T2 = mktable(T->key, T->value, T->left, ___remove(key, T->right), T->level);
-	else if (diff > 0)
-		T2 = mktable(T->key, T->value, ___remove(key, T->left), T->right, T->level);
-	else if (!T->left && !T->right) return NULL;
-	else if (!T->left) // T->right not null
+	// A Pike VM, giving the leftmost match and preferring longer matches from there, like POSIX.
+	if (!re->caps)
 	{
-		TABLE L = T->right;
-		while (L->left) L = L->left; // successor
-		T2 = mktable(L->key, L->value, T->left, ___remove(L->key, T->right), L->level);
+		re->caps = malloc(re->ncaps * sizeof *re->caps);
+		re->frames = malloc(2 * (re->ninsts + 1) * sizeof *re->frames);
 	}
-	else // left and right not null
+	regex_threads lists[2];
+	for (int i = 0 ; i < 2 ; ++i)
 	{
-		TABLE L = T->left;
-		while (L->right) L = L->right; // predecessor
-		T2 = mktable(L->key, L->value, ___remove(L->key, T->left), T->right, L->level);
+		lists[i] = re->sets[i];
+		lists[i].caps = malloc(re->ninsts * re->ncaps * sizeof *lists[i].caps);
+		lists[i].n = 0;
 	}
-
-	// below here idk really what's going on, but it seems to work:
-
-	if (T2->left && T2->right)
+	regex_threads* clist = &lists[0];
+	regex_threads* nlist = &lists[1];
+	size_t none[re->ncaps];
+	for (size_t i = 0 ; i < re->ncaps ; ++i) none[i] = best[i] = SIZE_MAX;
+
+	const char* const end = str + len;
+	const char* p = str + from;
+	if (re->prefix_len)
 	{
-		long llevel = T2->left->level;
-		long rlevel = T2->right->level;
-		long should_be = 1 + (llevel < rlevel ? llevel : rlevel);
-
-		if (should_be < T2->level)
+		p = memmem(p, end - p, re->prefix, re->prefix_len);
+		if (!p) p = end;
+	}
+	uint8_t flags = regex_flags_before(re, str, p);
+	uint32_t cp = REGEX_END;
+	size_t n = 0;
+	if (p < end) n = regex_decode(p, end, &cp);
+	bool matched = false;
+	for (;;)
+	{
+		if (!matched) regex_add_thread(re, clist, 0, none, p - str, flags, cp);
+		if (!clist->n) break;
+		const char* q = p + n;
+		uint32_t next_cp = REGEX_END;
+		size_t next_n = 0;
+		if (q < end) next_n = regex_decode(q, end, &next_cp);
+		const uint8_t next_flags = regex_flags(re, cp);
+		nlist->n = 0;
+		for (uint32_t i = 0 ; i < clist->n ; ++i)
 		{
-			T2->level = should_be;
-			if (should_be < T2->right->level)
-				T2->right->level = should_be;
+			const size_t* caps = clist->caps + i * re->ncaps;
+			if (matched && caps[0] > best[0]) continue;
+			const regex_inst inst = re->prog[clist->dense[i]];
+			if (inst.op == RE_MATCH)
+			{
+				if (!matched || caps[0] < best[0] || (caps[0] == best[0] && caps[1] > best[1]))
+					memcpy(best, caps, re->ncaps * sizeof *best);
+				matched = true;
+			}
+			else if (inst.op == RE_RANGES && cp < REGEX_END && regex_in_ranges(re->ranges + inst.x, inst.y, cp))
+				regex_add_thread(re, nlist, clist->dense[i] + 1, caps, q - str, next_flags, next_cp);
 		}
+		regex_threads* tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		if (p == end) break;
+		p = q;
+		cp = next_cp;
+		n = next_n;
+		flags = next_flags;
 	}
+	free(lists[0].caps);
+	free(lists[1].caps);
+	return matched;
+}
 
-	// This part makes at least vague sense:
-
-	/* Commented these bits out because the GC can't handle them
-	 * Probably worth implementing a recursive skew and split at some point.
-	 * IDK how balanced the table is gonna be after this
-	if (T2->right)
+static compiled_regex* memoized_regcomp(STRING reg_str)
+{
+	compiled_regex* re;
+	if (___has(box_STRING(reg_str), memoized_regexes)) re = (compiled_regex*)unbox_STRING(___D(box_STRING(reg_str), memoized_regexes));
+	else
 	{
-		T2->right->right = table_skew(T2->right->right);
-		T2->right = table_skew(T2->right);
+		// The compiled regex is outside the heap, so the GC leaves it alone.
+		re = compile_regex(reg_str);
+		memoized_regexes = ___insert(box_STRING(reg_str), box_STRING((char*)re), memoized_regexes);
 	}
-	*/
-	T2 = table_skew(T2);
-	//if (T2->right) T2->right = table_split(T2->right);
-	T2 = table_split(T2);
 
-	return T2;
+	return re;
 }
 
-static LIST values_helper(TABLE T, LIST L)
+static compiled_regex* literal_regcomp(compiled_regex** slot, STRING reg_str)
 {
-	if (!T) return L;
-	return values_helper(T->left, ___push(T->value, values_helper(T->right, L)));
+	// Literal patterns each have a static slot from the compiler, so they skip the table of memoized regexes.
+	if unlikely(!*slot) *slot = compile_regex(reg_str);
+	return *slot;
 }
 
-static LIST ___values(TABLE T)
+static BOOLEAN regex_test(compiled_regex* re, STRING str)
 {
-	return values_helper(T, NULL);
+	return regex_search(re, str, 0, strlen(str));
 }
 
-static LIST keys_helper(TABLE T, LIST L)
+static BOOLEAN ___regex(STRING reg_str, STRING str)
 {
-	if (!T) return L;
-	return keys_helper(T->left, ___push(T->key, keys_helper(T->right, L)));
+	return regex_test(memoized_regcomp(reg_str), str);
 }
 
-static LIST ___keys(TABLE T)
+static BOOLEAN ___regex_literal(compiled_regex** slot, STRING reg_str, STRING str)
 {
-	return keys_helper(T, NULL);
+	return regex_test(literal_regcomp(slot, reg_str), str);
 }
 
-static NUMBER ___length_TABLE(TABLE T)
+static BOOLEAN regex_match(compiled_regex* re, STRING str)
 {
-	if (!T) return 0;
-	return 1 + ___length_TABLE(T->left) + ___length_TABLE(T->right);
-}
+	const size_t len = strlen(str);
+	if (!regex_search(re, str, 0, len)) return false;
+	size_t groups = re->ncaps / 2;
+	size_t matches[re->ncaps];
+	regex_captures(re, str, 0, len, matches);
 
-static NUMBER ___length_LIST(LIST l)
-{
-	size_t len = 0;
-	while (l)
+	for (unsigned int g = 1; g < groups ; g++)
 	{
-		len++;
-		l = l->next;
+		if (matches[2 * g] == SIZE_MAX)
+		{
+			groups = g;
+			break;
+		}
 	}
-	return (NUMBER)len;
-}
-
-static NUMBER ___length_STRING(STRING str)
-{
-	size_t len = 0;
-	for (; *str ; str += mblen(str, MB_CUR_MAX), ++len);
-	return len;
-}
 
-static NUMBER ___length(ANY a)
-{
-	switch(type_of(a))
+	for (unsigned int g = groups-1; g > 0; g--)
 	{
-		case LIST_TYPE:   return ___length_LIST(unbox_LIST(a));
-		case STRING_TYPE: return ___length_STRING(unbox_STRING(a));
-		case TABLE_TYPE:  return ___length_TABLE(unbox_TABLE(a));
-		default: type_error("list or string or table", a);
+		size_t from = matches[2 * g];
+		size_t to = matches[2 * g + 1];
+		push(make_view(str + from, to - from, STRING_CHARS_UNKNOWN));
 	}
-#ifdef __TINYC__
-	return 0;
-#endif
+	return true;
 }
 
-static STRING ___show_NUMBER(NUMBER a)
+static BOOLEAN ___regexHmatch(STRING reg_str, STRING str)
 {
-	show_number(a, (char*)general_purpose_buffer);
-	return gc_strdup((char*)general_purpose_buffer);
+	return regex_match(memoized_regcomp(reg_str), str);
 }
 
-static STRING ___show_TABLE(TABLE a)
+static BOOLEAN ___regexHmatch_literal(compiled_regex** slot, STRING reg_str, STRING str)
 {
-	show_table(a, (char*)general_purpose_buffer, NULL);
-	return gc_strdup((char*)general_purpose_buffer);
+	return regex_match(literal_regcomp(slot, reg_str), str);
 }
 
-static STRING ___show_IO(IO a)
+static bool regex_next(compiled_regex* re, STRING str, size_t len, size_t* pos, size_t last, size_t* caps)
 {
-	show_io(a, (char*)general_purpose_buffer);
-	return gc_strdup((char*)general_purpose_buffer);
+	// Finds the next match from *pos, skipping an empty match where the last match ended, as sed does.
+	while (regex_search(re, str, *pos, len) && regex_captures(re, str, *pos, len, caps))
+	{
+		if (caps[0] != caps[1] || caps[0] != last) return true;
+		if (caps[0] == len) return false;
+		uint32_t cp;
+		*pos = caps[0] + regex_decode(str + caps[0], str + len, &cp);
+	}
+	return false;
 }
 
-static STRING ___show_STRING(STRING s)
+static LIST regex_find_all(compiled_regex* re, STRING str)
 {
-	return s;
+	// Matches are views of the string, and go on the stack as they're found so the list can be built from the end.
+	const size_t len = strlen(str);
+	size_t caps[re->ncaps];
+	ANYPTR matches = stack.top;
+	for (size_t pos = 0, last = SIZE_MAX ; regex_next(re, str, len, &pos, last, caps) ; pos = last = caps[1])
+		push(make_view(str + caps[0], caps[1] - caps[0], STRING_CHARS_UNKNOWN));
+	LIST lst = NULL;
+	for ( ; stack.top != matches ; --stack.top) lst = ___push(stack.top[-1], lst);
+	return lst;
 }
 
-static STRING ___show_BOOLEAN(BOOLEAN b)
+static LIST ___regexHfindHall(STRING reg_str, STRING str)
 {
-	return b ? "True" : "False";
+	return regex_find_all(memoized_regcomp(reg_str), str);
 }
 
-static STRING ___show_SYMBOL(SYMBOL s)
+static LIST ___regexHfindHall_literal(compiled_regex** slot, STRING reg_str, STRING str)
 {
-	return s;
+	return regex_find_all(literal_regcomp(slot, reg_str), str);
 }
 
-static STRING ___show_BLOCK(BLOCK b)
+static LIST regex_split(compiled_regex* re, STRING str)
 {
-	show_block(b, (char*)general_purpose_buffer);
-	return gc_strdup((char*)general_purpose_buffer);
+	// Like Split, the pieces are views and empty pieces are left out.
+	const size_t len = strlen(str);
+	size_t caps[re->ncaps];
+	ANYPTR pieces = stack.top;
+	size_t start = 0;
+	for (size_t pos = 0, last = SIZE_MAX ; regex_next(re, str, len, &pos, last, caps) ; pos = last = start = caps[1])
+		if (caps[0] != start) push(make_view(str + start, caps[0] - start, STRING_CHARS_UNKNOWN));
+	if (start != len) push(make_view(str + start, len - start, STRING_CHARS_UNKNOWN));
+	LIST lst = NULL;
+	for ( ; stack.top != pieces ; --stack.top) lst = ___push(stack.top[-1], lst);
+	return lst;
 }
 
-static STRING ___show_BOX(BOX b)
+static LIST ___regexHsplit(STRING reg_str, STRING str)
 {
-	show_box(b, (char*)general_purpose_buffer, NULL);
-	return gc_strdup((char*)general_purpose_buffer);
+	return regex_split(memoized_regcomp(reg_str), str);
 }
 
-static STRING ___show_LIST(LIST l)
+static LIST ___regexHsplit_literal(compiled_regex** slot, STRING reg_str, STRING str)
 {
-	show_list(l, (char*)general_purpose_buffer, NULL);
-	return gc_strdup((char*)general_purpose_buffer);
+	return regex_split(literal_regcomp(slot, reg_str), str);
 }
 
+static void regex_append(char** buf, size_t* n, size_t* cap, const char* s, size_t bytes)
+{
+	if (*n + bytes > *cap) *buf = realloc(*buf, *cap = (*n + bytes) * 2);
+	memcpy(*buf + *n, s, bytes);
+	*n += bytes;
+}
 
-
-static regex_t* memoized_regcomp(STRING reg_str)
+static STRING regex_replace(compiled_regex* re, STRING new, STRING str)
 {
-	regex_t* reg;
-	if (___has(box_STRING(reg_str), memoized_regexes)) reg = (regex_t*)unbox_STRING(___D(box_STRING(reg_str), memoized_regexes));
-	else
+	// The result is built outside the heap and copied once at the end. \0 to \9 in the replacement are sub-expressions.
+	const size_t len = strlen(str);
+	const size_t new_bytes = strlen(new);
+	for (size_t i = 0 ; i + 1 < new_bytes ; ++i)
+		if (new[i] == '\\' && isdigit((uint8_t)new[++i]) && (size_t)(new[i] - '0') >= re->ncaps / 2)
+			throw_error_fmt("Regex has no sub-expression \\%c", new[i]);
+	size_t caps[re->ncaps];
+	char* buf = NULL;
+	size_t bytes = 0, cap = 0, start = 0;
+	for (size_t pos = 0, last = SIZE_MAX ; regex_next(re, str, len, &pos, last, caps) ; pos = last = start = caps[1])
 	{
-		reg = gc_malloc(sizeof *reg);
-		const int status = regcomp(reg, reg_str, REG_EXTENDED | REG_NEWLINE);
-		errno = 0; // Hmmm
-		if unlikely(status)
+		regex_append(&buf, &bytes, &cap, str + start, caps[0] - start);
+		for (size_t i = 0 ; i < new_bytes ; ++i)
 		{
-			char reg_err[256];
-			regerror(status, reg, reg_err, 256);
-			throw_error_fmt("Compile error (%s) in regex '%.32s'", reg_err, reg_str);
+			if (new[i] != '\\' || i + 1 == new_bytes) regex_append(&buf, &bytes, &cap, new + i, 1);
+			else if (!isdigit((uint8_t)new[++i])) regex_append(&buf, &bytes, &cap, new + i, 1);
+			else
+			{
+				const size_t g = new[i] - '0';
+				if (caps[2 * g] != SIZE_MAX) regex_append(&buf, &bytes, &cap, str + caps[2 * g], caps[2 * g + 1] - caps[2 * g]);
+			}
 		}
-		memoized_regexes = ___insert(box_STRING(reg_str), box_STRING((char*)reg), memoized_regexes);
 	}
-
-	return reg;
+	regex_append(&buf, &bytes, &cap, str + start, len - start);
+	char* replaced = gc_malloc_string(bytes);
+	memcpy(replaced, buf, bytes);
+	free(buf);
+	return replaced;
 }
 
-static BOOLEAN ___regex(STRING reg_str, STRING str)
+static STRING ___regexHreplace(STRING reg_str, STRING new, STRING str)
 {
-	regex_t* reg = memoized_regcomp(reg_str);
-	const int found = regexec(reg, str, 0, NULL, 0);
-	if unlikely(found != 0 && found != REG_NOMATCH)
-		throw_error_fmt("Regex failed matching string '%.32s'", str);
-
-	return found != REG_NOMATCH;
+	return regex_replace(memoized_regcomp(reg_str), new, str);
 }
 
-static BOOLEAN ___regexHmatch(STRING reg_str, STRING str)
+static STRING ___regexHreplace_literal(compiled_regex** slot, STRING reg_str, STRING new, STRING str)
 {
-	regex_t* reg = memoized_regcomp(reg_str);
-
-	size_t groups = reg->re_nsub + 1;
-	regmatch_t matches[groups];
-	const int found = regexec(reg, str, groups, matches, 0);
-	if unlikely(found != 0 && found != REG_NOMATCH) throw_error_fmt("Regex failed matching string '%.32s'", str);
-
-	if (found == 0) {
-		for (unsigned int g = 1; g < groups ; g++)
-		{
-			size_t from = matches[g].rm_so;
-			if (from == (size_t)-1)
-			{
-				groups = g;
-				break;
-			}
-		}
-
-		for (unsigned int g = groups-1; g > 0; g--)
-		{
-			size_t from = matches[g].rm_so;
-			size_t to = matches[g].rm_eo;
-			char* item = gc_strndup((char*)str, to);
-			push(box_STRING(item + from));
-		}
-	}
-	return found != REG_NOMATCH;
+	return regex_replace(literal_regcomp(slot, reg_str), new, str);
 }
 
 static LIST ___append_LIST(LIST l1, LIST l2)
@@ -2730,12 +6936,16 @@ static LIST ___append_LIST(LIST l1, LIST l2)
 
 static STRING ___append_STRING(STRING s1, STRING s2)
 {
-	size_t len1 = strlen(s1);
-	size_t len2 = strlen(s2);
-	char* output = gc_malloc(len1 + len2 + 1);
-	strcpy(output, s2);
-	strcpy(output+len2, s1);
-	output[len1+len2] = '\0';
+	string_header* h1 = string_header_of(s1);
+	string_header* h2 = string_header_of(s2);
+	size_t len1 = h1 ? h1->bytes : strlen(s1);
+	size_t len2 = h2 ? h2->bytes : strlen(s2);
+	size_t chars = h1 && h2 && h1->chars != STRING_CHARS_UNKNOWN && h2->chars != STRING_CHARS_UNKNOWN
+		? h1->chars + h2->chars : STRING_CHARS_UNKNOWN;
+	char* output = gc_malloc_string(len1 + len2);
+	memcpy(output, s2, len2);
+	memcpy(output + len2, s1, len1);
+	((string_header*)output - 1)->chars = chars;
 	return (STRING)output;
 }
 
@@ -2747,8 +6957,24 @@ static ANY ___append(ANY a1, ANY a2)
 		case LIST_TYPE:
 			return box_LIST(___append_LIST(unbox_LIST(a1), unbox_LIST(a2)));
 		case STRING_TYPE:
+			if (!flat_string(a1) || !flat_string(a2))
+			{
+				// Copied straight out of the views, rather than flattening them first.
+				if unlikely(!___stringQ(a2)) type_error("string", a2);
+				size_t n1, n2;
+				STRING s1 = string_span(&a1, &n1);
+				STRING s2 = string_span(&a2, &n2);
+				char* output = gc_malloc_string(n1 + n2);
+				memcpy(output, s2, n2);
+				memcpy(output + n2, s1, n1);
+				return box_STRING(output);
+			}
 			return box_STRING(___append_STRING(unbox_STRING(a1), unbox_STRING(a2)));
-		default: type_error("List or String", a1);
+		case SEQUENCE_TYPE:
+			return box_SEQUENCE(___append_SEQUENCE(unbox_SEQUENCE(a1), unbox_SEQUENCE(a2)));
+		case BYTES_TYPE:
+			return box_BYTES(___append_BYTES(unbox_BYTES(a1), unbox_BYTES(a2)));
+		default: type_error("List or String or Sequence or Bytes", a1);
 	}
 	#ifdef __TINYC__
 	return NIL;